@@ -0,0 +1,470 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-archive.h"
+#include "libvc-gdm70x-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* File layout, all numbers little endian:
+
+   header   8 bytes magic "GDM70XA\0", u32 version, u32 reserved
+   entry    u8 type ('K' keyframe, 'D' delta), u8 reserved, u16 size,
+            u32 nsec, u64 sec, followed by size bytes of payload
+   index    per entry: u64 sec, u32 nsec, u8 type, u8 reserved, u16 size,
+            u64 offset of the entry
+   trailer  u64 offset of the index, u64 number of entries,
+            8 bytes magic "GDM70XI\0" */
+
+#define ARCHIVE_HEADER  16
+#define ARCHIVE_ENTRY   16
+#define ARCHIVE_INDEX   24
+#define ARCHIVE_TRAILER 24
+
+static const char archive_magic[8] = "GDM70XA";
+static const char index_magic[8]   = "GDM70XI";
+
+static int
+archive_addindex(struct vc_gdm70x_archive* ar_p, const struct timespec* ts,
+		 unsigned long long offset, int type, int size)
+{
+  struct vc_gdm70x_archive_index* index_p;
+
+  if(ar_p->count == ar_p->alloc) {
+    index_p = realloc(ar_p->index, (ar_p->alloc ? ar_p->alloc * 2 : 256) *
+		      sizeof(*index_p));
+    if(!index_p) {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_archive: realloc failed.\n",stderr);
+      return -1;
+    }
+    ar_p->index = index_p;
+    ar_p->alloc = ar_p->alloc ? ar_p->alloc * 2 : 256;
+  }
+
+  index_p = ar_p->index + ar_p->count;
+  index_p->ts = *ts;
+  index_p->offset = offset;
+  index_p->size = size;
+  index_p->delta = (type == 'D');
+
+  if(index_p->delta) {
+    if(ar_p->count == 0)
+      return -1;
+    index_p->key = index_p[-1].delta ? index_p[-1].key : ar_p->count - 1;
+  } else
+    index_p->key = ar_p->count;
+
+  ar_p->count++;
+  ar_p->end = offset + ARCHIVE_ENTRY + size;
+
+  return 0;
+}
+
+static int
+archive_checkentry(int type, int size)
+{
+  if(type == 'K')
+    return size == VC_GDM70X_IMAGE_SIZE ? 0 : -1;
+  if(type == 'D')
+    return (size > 0 && size <= VC_GDM70X_DELTA_MAX) ? 0 : -1;
+  return -1;
+}
+
+/* archive_loadindex: read the index written by vc_gdm70x_archive_close */
+static int
+archive_loadindex(struct vc_gdm70x_archive* ar_p, unsigned long long size)
+{
+  unsigned char buf[ARCHIVE_TRAILER];
+  unsigned char* index;
+  unsigned long long offset, count, i;
+  struct timespec ts;
+  int retval = 0;
+
+  if(size < ARCHIVE_HEADER + ARCHIVE_TRAILER)
+    return -1;
+
+  if(pread(ar_p->fd, buf, ARCHIVE_TRAILER, size - ARCHIVE_TRAILER) != ARCHIVE_TRAILER)
+    return -1;
+
+  if(memcmp(buf + 16, index_magic, 8))
+    return -1;
+
+  offset = vc_gdm70x_get64(buf);
+  count  = vc_gdm70x_get64(buf + 8);
+
+  if( (offset < ARCHIVE_HEADER) || (count > (size - offset) / ARCHIVE_INDEX) ||
+      (offset + count * ARCHIVE_INDEX + ARCHIVE_TRAILER != size))
+    return -1;
+
+  index = malloc(count * ARCHIVE_INDEX + 1);
+  if(!index)
+    return -1;
+
+  if(pread(ar_p->fd, index, count * ARCHIVE_INDEX, offset) != (ssize_t) (count * ARCHIVE_INDEX))
+    retval = -1;
+
+  for(i = 0; (i < count) && !retval; i++) {
+    const unsigned char* p = index + i * ARCHIVE_INDEX;
+
+    ts.tv_sec  = (int64_t) vc_gdm70x_get64(p);
+    ts.tv_nsec = vc_gdm70x_get32(p + 8);
+
+    if(archive_checkentry(p[12], vc_gdm70x_get16(p + 14)) ||
+       (vc_gdm70x_get64(p + 16) != ar_p->end) ||
+       archive_addindex(ar_p, &ts, vc_gdm70x_get64(p + 16), p[12], vc_gdm70x_get16(p + 14)))
+      retval = -1;
+  }
+
+  free(index);
+
+  if(retval || ar_p->end != offset) {
+    ar_p->count = 0;
+    ar_p->end = ARCHIVE_HEADER;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* archive_scan: rebuild the index by walking the entries */
+static void
+archive_scan(struct vc_gdm70x_archive* ar_p, unsigned long long size)
+{
+  unsigned char buf[ARCHIVE_ENTRY];
+  unsigned long long offset = ARCHIVE_HEADER;
+  struct timespec ts;
+  int type, len;
+
+  if(vc_gdm70x_verbose > 1)
+    fputs("vc_gdm70x_archive_open: no index, scanning entries.\n",stderr);
+
+  ar_p->count = 0;
+  ar_p->end = ARCHIVE_HEADER;
+
+  while(offset + ARCHIVE_ENTRY <= size) {
+    if(pread(ar_p->fd, buf, ARCHIVE_ENTRY, offset) != ARCHIVE_ENTRY)
+      break;
+
+    type = buf[0];
+    len  = vc_gdm70x_get16(buf + 2);
+
+    if(archive_checkentry(type, len) || (offset + ARCHIVE_ENTRY + len > size))
+      break;
+
+    ts.tv_nsec = vc_gdm70x_get32(buf + 4);
+    ts.tv_sec  = (int64_t) vc_gdm70x_get64(buf + 8);
+
+    if(archive_addindex(ar_p, &ts, offset, type, len))
+      break;
+
+    offset = ar_p->end;
+  }
+}
+
+struct vc_gdm70x_archive*
+vc_gdm70x_archive_open(const char* filename, int mode)
+{
+  struct vc_gdm70x_archive* ar_p;
+  unsigned char header[ARCHIVE_HEADER];
+  struct stat st;
+
+  assert(filename);
+
+  ar_p = malloc(sizeof(struct vc_gdm70x_archive));
+  if(!ar_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_archive_open: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(ar_p,0,sizeof(struct vc_gdm70x_archive));
+  ar_p->mode = mode;
+  ar_p->end = ARCHIVE_HEADER;
+
+  if(mode == VC_GDM70X_ARCHIVE_APPEND)
+    ar_p->fd = open(filename, O_RDWR | O_CREAT, 0666);
+  else
+    ar_p->fd = open(filename, O_RDONLY);
+
+  if(ar_p->fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_archive_open: open failed");
+    free(ar_p);
+    return 0;
+  }
+
+  if(fstat(ar_p->fd, &st)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_archive_open: fstat failed");
+    goto error;
+  }
+
+  if( (st.st_size == 0) && (mode == VC_GDM70X_ARCHIVE_APPEND)) {
+    memset(header,0,ARCHIVE_HEADER);
+    memcpy(header,archive_magic,8);
+    vc_gdm70x_put32(header + 8, 1);
+
+    if(write(ar_p->fd, header, ARCHIVE_HEADER) != ARCHIVE_HEADER) {
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_archive_open: write failed");
+      goto error;
+    }
+    return ar_p;
+  }
+
+  if( (pread(ar_p->fd, header, ARCHIVE_HEADER, 0) != ARCHIVE_HEADER) ||
+      memcmp(header, archive_magic, 8) || (vc_gdm70x_get32(header + 8) != 1)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_archive_open: not an archive.\n",stderr);
+    goto error;
+  }
+
+  if(archive_loadindex(ar_p, st.st_size))
+    archive_scan(ar_p, st.st_size);
+
+  /* the index gets rewritten on close, new entries replace it */
+  if(mode == VC_GDM70X_ARCHIVE_APPEND) {
+    if(ftruncate(ar_p->fd, ar_p->end) || (lseek(ar_p->fd, ar_p->end, SEEK_SET) < 0)) {
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_archive_open: truncate failed");
+      goto error;
+    }
+  }
+
+  return ar_p;
+
+ error:
+  close(ar_p->fd);
+  free(ar_p->index);
+  free(ar_p);
+  return 0;
+}
+
+int
+vc_gdm70x_archive_close(struct vc_gdm70x_archive* ar_p)
+{
+  unsigned char* buf;
+  unsigned long i;
+  int retval = 0;
+
+  assert(ar_p);
+
+  if(ar_p->mode == VC_GDM70X_ARCHIVE_APPEND) {
+    buf = malloc(ar_p->count * ARCHIVE_INDEX + ARCHIVE_TRAILER);
+
+    if(buf) {
+      memset(buf,0,ar_p->count * ARCHIVE_INDEX + ARCHIVE_TRAILER);
+
+      for(i = 0; i < ar_p->count; i++) {
+	unsigned char* p = buf + i * ARCHIVE_INDEX;
+
+	vc_gdm70x_put64(p, ar_p->index[i].ts.tv_sec);
+	vc_gdm70x_put32(p + 8, ar_p->index[i].ts.tv_nsec);
+	p[12] = ar_p->index[i].delta ? 'D' : 'K';
+	vc_gdm70x_put16(p + 14, ar_p->index[i].size);
+	vc_gdm70x_put64(p + 16, ar_p->index[i].offset);
+      }
+
+      vc_gdm70x_put64(buf + i * ARCHIVE_INDEX, ar_p->end);
+      vc_gdm70x_put64(buf + i * ARCHIVE_INDEX + 8, ar_p->count);
+      memcpy(buf + i * ARCHIVE_INDEX + 16, index_magic, 8);
+
+      if(pwrite(ar_p->fd, buf, i * ARCHIVE_INDEX + ARCHIVE_TRAILER, ar_p->end) !=
+	 (ssize_t) (i * ARCHIVE_INDEX + ARCHIVE_TRAILER)) {
+	if(vc_gdm70x_verbose)
+	  perror("vc_gdm70x_archive_close: write failed");
+	retval = -1;
+      }
+
+      free(buf);
+    } else {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_archive_close: malloc failed, index not written.\n",stderr);
+      retval = -1;
+    }
+  }
+
+  if(close(ar_p->fd)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_archive_close: close failed");
+    retval = -1;
+  }
+
+  free(ar_p->index);
+  free(ar_p);
+
+  return retval;
+}
+
+int
+vc_gdm70x_archive_setkeyframe(struct vc_gdm70x_archive* ar_p, int count)
+{
+  assert(ar_p);
+
+  if(count < 0)
+    return -1;
+
+  ar_p->keyframe_interval = count;
+
+  return 0;
+}
+
+int
+vc_gdm70x_archive_append(struct vc_gdm70x_archive* ar_p,
+			 const struct timespec* ts, const unsigned char* image)
+{
+  unsigned char header[ARCHIVE_ENTRY];
+  unsigned char delta[VC_GDM70X_DELTA_MAX];
+  struct iovec iov[2];
+  int type = 'K', size = VC_GDM70X_IMAGE_SIZE;
+
+  assert(ar_p);
+  assert(ts);
+  assert(image);
+  assert(ar_p->mode == VC_GDM70X_ARCHIVE_APPEND);
+
+  iov[1].iov_base = (void*) image;
+
+  if(ar_p->key_valid && (ar_p->delta_count < ar_p->keyframe_interval)) {
+    size = vc_gdm70x_image_delta(ar_p->key, image, delta);
+    if(size < VC_GDM70X_IMAGE_SIZE) {
+      type = 'D';
+      iov[1].iov_base = delta;
+    } else
+      size = VC_GDM70X_IMAGE_SIZE;
+  }
+
+  memset(header,0,ARCHIVE_ENTRY);
+  header[0] = type;
+  vc_gdm70x_put16(header + 2, size);
+  vc_gdm70x_put32(header + 4, ts->tv_nsec);
+  vc_gdm70x_put64(header + 8, ts->tv_sec);
+
+  iov[0].iov_base = header;
+  iov[0].iov_len  = ARCHIVE_ENTRY;
+  iov[1].iov_len  = size;
+
+  if(writev(ar_p->fd, iov, 2) != ARCHIVE_ENTRY + size) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_archive_append: write failed");
+
+    /* drop a partial entry, the next one is indexed at ar_p->end */
+    if(ftruncate(ar_p->fd, ar_p->end) || (lseek(ar_p->fd, ar_p->end, SEEK_SET) < 0))
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_archive_append: truncate failed");
+    return -1;
+  }
+
+  if(archive_addindex(ar_p, ts, ar_p->end, type, size))
+    return -1;
+
+  if(type == 'K') {
+    memcpy(ar_p->key, image, VC_GDM70X_IMAGE_SIZE);
+    ar_p->key_valid = 1;
+    ar_p->delta_count = 0;
+  } else
+    ar_p->delta_count++;
+
+  return 0;
+}
+
+long
+vc_gdm70x_archive_find(struct vc_gdm70x_archive* ar_p, const struct timespec* ts)
+{
+  unsigned long lo = 0, hi, mid;
+  const struct timespec* p;
+
+  assert(ar_p);
+  assert(ts);
+
+  hi = ar_p->count;
+
+  /* first entry later than ts */
+  while(lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    p = &(ar_p->index[mid].ts);
+
+    if( (p->tv_sec < ts->tv_sec) ||
+	((p->tv_sec == ts->tv_sec) && (p->tv_nsec <= ts->tv_nsec)))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (long) lo - 1;
+}
+
+static int
+archive_readpayload(struct vc_gdm70x_archive* ar_p, unsigned long n, unsigned char* buf)
+{
+  const struct vc_gdm70x_archive_index* index_p = ar_p->index + n;
+
+  if(pread(ar_p->fd, buf, index_p->size, index_p->offset + ARCHIVE_ENTRY) != index_p->size) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_archive_get: read failed");
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+vc_gdm70x_archive_get(struct vc_gdm70x_archive* ar_p, unsigned long n,
+		      struct timespec* ts, unsigned char* image)
+{
+  unsigned char key[VC_GDM70X_IMAGE_SIZE];
+  unsigned char delta[VC_GDM70X_DELTA_MAX];
+  const struct vc_gdm70x_archive_index* index_p;
+
+  assert(ar_p);
+
+  if(n >= ar_p->count) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_archive_get: no such image.\n",stderr);
+    return -1;
+  }
+
+  index_p = ar_p->index + n;
+
+  if(ts)
+    *ts = index_p->ts;
+
+  if(!image)
+    return 0;
+
+  if(!index_p->delta)
+    return archive_readpayload(ar_p, n, image);
+
+  if(archive_readpayload(ar_p, index_p->key, key) ||
+     archive_readpayload(ar_p, n, delta))
+    return -1;
+
+  return vc_gdm70x_image_undelta(key, delta, index_p->size, image);
+}
@@ -0,0 +1,341 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-capture.h"
+#include "libvc-gdm70x-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+static const char capture_magic[8] = VC_GDM70X_CAPTURE_MAGIC;
+
+static unsigned long long
+capture_now(clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct vc_gdm70x_capture*
+capture_alloc(int fd, int mode)
+{
+  struct vc_gdm70x_capture* cap_p;
+
+  cap_p = malloc(sizeof(struct vc_gdm70x_capture));
+  if(!cap_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_capture: malloc failed.\n",stderr);
+    close(fd);
+    return 0;
+  }
+
+  memset(cap_p, 0, sizeof(struct vc_gdm70x_capture));
+  cap_p->fd = fd;
+  cap_p->mode = mode;
+
+  return cap_p;
+}
+
+void
+vc_gdm70x_capture_close(struct vc_gdm70x_capture* cap_p)
+{
+  if(!cap_p)
+    return;
+
+  if(close(cap_p->fd))
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_capture_close: close failed");
+
+  free(cap_p);
+}
+
+int
+vc_gdm70x_tap(struct vc_gdm70x* gdm_p, const char* filename)
+{
+  struct vc_gdm70x_capture* cap_p;
+  unsigned char header[VC_GDM70X_CAPTURE_HEADER];
+  int fd;
+
+  assert(gdm_p);
+
+  vc_gdm70x_capture_close(gdm_p->tap);
+  gdm_p->tap = 0;
+
+  if(!filename)
+    return 0;
+
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if(fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_tap: open failed");
+    return -1;
+  }
+
+  cap_p = capture_alloc(fd, VC_GDM70X_CAPTURE_TAP);
+  if(!cap_p)
+    return -1;
+
+  cap_p->real = capture_now(CLOCK_REALTIME);
+  cap_p->mono = capture_now(CLOCK_MONOTONIC);
+
+  memcpy(header, capture_magic, 8);
+  vc_gdm70x_put32(header + 8, 1);
+  vc_gdm70x_put32(header + 12, 0);
+  vc_gdm70x_put64(header + 16, cap_p->real);
+  vc_gdm70x_put64(header + 24, cap_p->mono);
+
+  if(write(fd, header, sizeof(header)) != sizeof(header)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_tap: write failed");
+    vc_gdm70x_capture_close(cap_p);
+    return -1;
+  }
+
+  gdm_p->tap = cap_p;
+
+  return 0;
+}
+
+int
+vc_gdm70x_capture_write(struct vc_gdm70x_capture* cap_p, const void* buf, int size)
+{
+  unsigned char chunk[VC_GDM70X_CAPTURE_CHUNK];
+  struct iovec iov[2];
+
+  assert(cap_p);
+  assert(buf);
+
+  vc_gdm70x_put64(chunk, capture_now(CLOCK_MONOTONIC));
+  vc_gdm70x_put32(chunk + 8, size);
+
+  iov[0].iov_base = chunk;
+  iov[0].iov_len  = sizeof(chunk);
+  iov[1].iov_base = (void*) buf;
+  iov[1].iov_len  = size;
+
+  if(writev(cap_p->fd, iov, 2) != (ssize_t) sizeof(chunk) + size) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_capture_write: writev failed");
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+vc_gdm70x_open_replay(struct vc_gdm70x* gdm_p, const char* filename, int mode)
+{
+  struct vc_gdm70x_capture* cap_p;
+  unsigned char header[VC_GDM70X_CAPTURE_HEADER];
+  int fd;
+
+  assert(gdm_p);
+  assert(filename);
+  assert(gdm_p->fd < 0);
+
+  if( (mode != VC_GDM70X_REPLAY_FAST) && (mode != VC_GDM70X_REPLAY_PACED)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_open_replay: invalid mode.\n",stderr);
+    return -1;
+  }
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_open_replay: open failed");
+    return -1;
+  }
+
+  if(read(fd, header, sizeof(header)) != sizeof(header) ||
+     memcmp(header, capture_magic, 8) || vc_gdm70x_get32(header + 8) != 1) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_open_replay: not a capture file.\n",stderr);
+    close(fd);
+    return -1;
+  }
+
+  cap_p = capture_alloc(fd, mode);
+  if(!cap_p)
+    return -1;
+
+  cap_p->real = vc_gdm70x_get64(header + 16);
+  cap_p->mono = vc_gdm70x_get64(header + 24);
+
+  gdm_p->replay = cap_p;
+  gdm_p->fd = fd;
+  gdm_p->sync = 0;
+  gdm_p->error = 0;
+
+  return 0;
+}
+
+/* capture_fill: make at least size bytes available in the buffer,
+   returns 0 at the end of the file */
+static int
+capture_fill(struct vc_gdm70x_capture* cap_p, size_t size)
+{
+  ssize_t bytes;
+
+  if(cap_p->len - cap_p->pos >= size)
+    return 1;
+
+  memmove(cap_p->buf, cap_p->buf + cap_p->pos, cap_p->len - cap_p->pos);
+  cap_p->len -= cap_p->pos;
+  cap_p->pos = 0;
+
+  while(cap_p->len < size) {
+    bytes = read(cap_p->fd, cap_p->buf + cap_p->len,
+		 sizeof(cap_p->buf) - cap_p->len);
+    if(bytes < 0 && errno == EINTR)
+      continue;
+    if(bytes < 0) {
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_capture_read: read failed");
+      return -1;
+    }
+    if(bytes == 0)
+      return 0;
+    cap_p->len += bytes;
+  }
+
+  return 1;
+}
+
+/* capture_pace: wait until the chunk is due */
+static void
+capture_pace(struct vc_gdm70x_capture* cap_p)
+{
+  unsigned long long due;
+  struct timespec ts;
+
+  if(!cap_p->started) {
+    clock_gettime(CLOCK_MONOTONIC, &(cap_p->start));
+    cap_p->first = cap_p->chunk;
+    cap_p->started = 1;
+    return;
+  }
+
+  due = (unsigned long long) cap_p->start.tv_sec * 1000000000ULL +
+        cap_p->start.tv_nsec + (cap_p->chunk - cap_p->first);
+
+  ts.tv_sec  = due / 1000000000ULL;
+  ts.tv_nsec = due % 1000000000ULL;
+
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+int
+vc_gdm70x_capture_read(struct vc_gdm70x_capture* cap_p, void* buf, int size)
+{
+  int n;
+
+  assert(cap_p);
+  assert(buf);
+
+  while(cap_p->left == 0) {
+    if(cap_p->eof)
+      return 0;
+
+    switch(capture_fill(cap_p, VC_GDM70X_CAPTURE_CHUNK)) {
+    case -1:
+      errno = EIO;
+      return -1;
+    case 0:
+      cap_p->eof = 1;
+      return 0;
+    }
+
+    cap_p->chunk = vc_gdm70x_get64(cap_p->buf + cap_p->pos);
+    cap_p->left  = vc_gdm70x_get32(cap_p->buf + cap_p->pos + 8);
+    cap_p->pos  += VC_GDM70X_CAPTURE_CHUNK;
+
+    if(cap_p->mode == VC_GDM70X_REPLAY_PACED)
+      capture_pace(cap_p);
+  }
+
+  n = (size < (int) cap_p->left) ? size : (int) cap_p->left;
+
+  switch(capture_fill(cap_p, 1)) {
+  case -1:
+    errno = EIO;
+    return -1;
+  case 0:
+    /* truncated chunk, e.g. the writer was killed */
+    cap_p->eof = 1;
+    cap_p->left = 0;
+    return 0;
+  }
+
+  if((size_t) n > cap_p->len - cap_p->pos)
+    n = cap_p->len - cap_p->pos;
+
+  memcpy(buf, cap_p->buf + cap_p->pos, n);
+  cap_p->pos  += n;
+  cap_p->left -= n;
+
+  return n;
+}
+
+int
+vc_gdm70x_capture_pending(const struct vc_gdm70x_capture* cap_p)
+{
+  assert(cap_p);
+
+  return cap_p->left;
+}
+
+void
+vc_gdm70x_capture_time(const struct vc_gdm70x_capture* cap_p, struct timespec* ts)
+{
+  unsigned long long t;
+
+  assert(cap_p);
+  assert(ts);
+
+  t = cap_p->real + (cap_p->chunk - cap_p->mono);
+
+  ts->tv_sec  = t / 1000000000ULL;
+  ts->tv_nsec = t % 1000000000ULL;
+}
+
+int
+vc_gdm70x_capture_start(const struct vc_gdm70x* gdm_p, struct timespec* ts)
+{
+  assert(gdm_p);
+  assert(ts);
+
+  if(!gdm_p->replay)
+    return -1;
+
+  ts->tv_sec  = gdm_p->replay->real / 1000000000ULL;
+  ts->tv_nsec = gdm_p->replay->real % 1000000000ULL;
+
+  return 0;
+}
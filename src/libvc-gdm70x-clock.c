@@ -0,0 +1,197 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+struct vc_gdm70x_clock*
+vc_gdm70x_clock_create(int window)
+{
+  struct vc_gdm70x_clock* clk_p;
+
+  assert(window >= 2);
+
+  clk_p = malloc(sizeof(struct vc_gdm70x_clock));
+  if(!clk_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_clock_create: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(clk_p,0,sizeof(struct vc_gdm70x_clock));
+  clk_p->window = window;
+
+  clk_p->point = malloc(window * sizeof(struct vc_gdm70x_clock_point));
+  if(!clk_p->point) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_clock_create: malloc failed.\n",stderr);
+    free(clk_p);
+    return 0;
+  }
+
+  vc_gdm70x_clock_reset(clk_p);
+
+  return clk_p;
+}
+
+void
+vc_gdm70x_clock_destroy(struct vc_gdm70x_clock* clk_p)
+{
+  if(!clk_p)
+    return;
+
+  free(clk_p->point);
+  free(clk_p);
+}
+
+void
+vc_gdm70x_clock_reset(struct vc_gdm70x_clock* clk_p)
+{
+  assert(clk_p);
+
+  clk_p->count = 0;
+  clk_p->head = 0;
+  clk_p->index = -1;
+  clk_p->period = 0;
+}
+
+/* clock_round: round to the nearest integer, without libm */
+static long long
+clock_round(double x)
+{
+  return (x < 0) ? -(long long) (0.5 - x) : (long long) (x + 0.5);
+}
+
+static double
+clock_diff(const struct timespec* a, const struct timespec* b)
+{
+  return (double) (a->tv_sec - b->tv_sec) + (double) (a->tv_nsec - b->tv_nsec) * 1e-9;
+}
+
+/* clock_fit: fit t = offset + period * (index - last index) through the
+   window, times relative to the last arrival */
+static void
+clock_fit(struct vc_gdm70x_clock* clk_p, const struct timespec* last,
+	  double* offset)
+{
+  const struct vc_gdm70x_clock_point* p;
+  double x, y, sx = 0, sy = 0, sxx = 0, sxy = 0, n = clk_p->count, d;
+  int i;
+
+  for(i = 0; i < clk_p->count; i++) {
+    p = clk_p->point + (clk_p->head + i) % clk_p->window;
+    x = (double) (p->index - clk_p->index);
+    y = clock_diff(&(p->ts), last);
+    sx += x; sy += y; sxx += x * x; sxy += x * y;
+  }
+
+  d = n * sxx - sx * sx;
+
+  if(clk_p->count < 2 || d <= 0) {
+    *offset = 0;
+    return;
+  }
+
+  clk_p->period = (n * sxy - sx * sy) / d;
+  *offset = (sy - clk_p->period * sx) / n;
+}
+
+long
+vc_gdm70x_clock_update(struct vc_gdm70x_clock* clk_p, const struct timespec* ts)
+{
+  struct vc_gdm70x_clock_point* p;
+  double offset, dt;
+  long long step = 1;
+  long nsec;
+
+  assert(clk_p);
+  assert(ts);
+
+  if(clk_p->count > 0) {
+    p = clk_p->point + (clk_p->head + clk_p->count - 1) % clk_p->window;
+    dt = clock_diff(ts, &(p->ts));
+
+    /* the period is trusted once fitted over some intervals. Records
+       arriving much faster were queued and come in a burst */
+    if(clk_p->period > 0 && dt >= clk_p->period / 2 &&
+       (clk_p->count >= VC_GDM70X_CLOCK_BOOTSTRAP || clk_p->count == clk_p->window))
+      step = clock_round(dt / clk_p->period);
+
+    /* the host clock may step backwards */
+    if(step < 1)
+      step = 1;
+
+    /* the period is not exact enough to bridge long outages, estimate
+       it again afterwards */
+    if(step > clk_p->window) {
+      clk_p->count = 0;
+      clk_p->head = 0;
+      clk_p->period = 0;
+    }
+  }
+
+  clk_p->index += step;
+
+  /* add the point, dropping the oldest one */
+  if(clk_p->count == clk_p->window) {
+    clk_p->head = (clk_p->head + 1) % clk_p->window;
+    clk_p->count--;
+  }
+
+  p = clk_p->point + (clk_p->head + clk_p->count) % clk_p->window;
+  p->index = clk_p->index;
+  p->ts = *ts;
+  clk_p->count++;
+
+  clock_fit(clk_p, ts, &offset);
+
+  /* smoothed time = arrival time + offset of the fit */
+  nsec = ts->tv_nsec + clock_round(offset * 1e9);
+  clk_p->ts.tv_sec = ts->tv_sec + nsec / 1000000000L;
+  nsec %= 1000000000L;
+  if(nsec < 0) {
+    nsec += 1000000000L;
+    clk_p->ts.tv_sec--;
+  }
+  clk_p->ts.tv_nsec = nsec;
+
+  clk_p->missing += step - 1;
+
+  return step - 1;
+}
+
+int
+vc_gdm70x_clock_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_clock* clk_p = ptr;
+
+  assert(gdm_p);
+  assert(clk_p);
+
+  vc_gdm70x_clock_update(clk_p, &(gdm_p->ts));
+  gdm_p->ts = clk_p->ts;
+
+  return 0;
+}
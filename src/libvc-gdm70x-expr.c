@@ -0,0 +1,436 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-expr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+/* parser state, code is emitted while parsing */
+struct parser {
+  const char* p;
+  const struct vc_gdm70x_expr* expr_p;
+  struct vc_gdm70x_expr_def* def_p;
+  int depth;
+  int error;
+};
+
+static int parse_sum(struct parser* ps);
+
+static void
+emit(struct parser* ps, int op, int arg, double value, int push)
+{
+  struct vc_gdm70x_expr_insn* insn_p;
+
+  if(ps->def_p->length == VC_GDM70X_EXPR_CODE) {
+    ps->error = 1;
+    return;
+  }
+
+  ps->depth += push;
+  if(ps->depth > VC_GDM70X_EXPR_STACK)
+    ps->error = 1;
+
+  insn_p = ps->def_p->code + ps->def_p->length++;
+  insn_p->op = op;
+  insn_p->arg = arg;
+  insn_p->value = value;
+}
+
+static void
+skip_space(struct parser* ps)
+{
+  while(isspace((unsigned char) *ps->p))
+    ps->p++;
+}
+
+static size_t
+name_length(const char* p)
+{
+  size_t len = 0;
+
+  if(isalpha((unsigned char) *p) || *p == '_')
+    while(isalnum((unsigned char) p[len]) || p[len] == '_')
+      len++;
+
+  return len;
+}
+
+static int
+expect(struct parser* ps, char c)
+{
+  skip_space(ps);
+
+  if(*ps->p != c)
+    return -1;
+
+  ps->p++;
+  return 0;
+}
+
+static const struct { const char* name; int op; int args; } funcs[] = {
+  { "abs", VC_GDM70X_EXPR_ABS, 1 },
+  { "min", VC_GDM70X_EXPR_MIN, 2 },
+  { "max", VC_GDM70X_EXPR_MAX, 2 },
+};
+
+/* find_func: index of the function name with len characters, -1 if
+   there is none */
+static int
+find_func(const char* name, size_t len)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(funcs) / sizeof(funcs[0]); i++)
+    if(strlen(funcs[i].name) == len && !strncmp(name, funcs[i].name, len))
+      return i;
+
+  return -1;
+}
+
+/* parse_primary: number, channel, derived value, function or (sum) */
+static int
+parse_primary(struct parser* ps)
+{
+  char* end;
+  double value;
+  size_t len;
+  int index;
+
+  skip_space(ps);
+
+  if(isdigit((unsigned char) *ps->p) || *ps->p == '.') {
+    value = strtod(ps->p, &end);
+    if(end == ps->p)
+      return -1;
+
+    switch(*end) {
+    case 'n': value *= 1e-9; end++; break;
+    case 'u': value *= 1e-6; end++; break;
+    case 'm': value *= 1e-3; end++; break;
+    case 'k': value *= 1e3;  end++; break;
+    case 'M': value *= 1e6;  end++; break;
+    }
+
+    ps->p = end;
+    emit(ps, VC_GDM70X_EXPR_CONST, 0, value, 1);
+    return 0;
+  }
+
+  if(*ps->p == '(') {
+    ps->p++;
+    return (parse_sum(ps) || expect(ps, ')')) ? -1 : 0;
+  }
+
+  len = name_length(ps->p);
+  if(len == 0)
+    return -1;
+
+  if(len == 2 && ps->p[0] == 'D' && (ps->p[1] == '1' || ps->p[1] == '2')) {
+    emit(ps, (ps->p[1] == '1') ? VC_GDM70X_EXPR_D1 : VC_GDM70X_EXPR_D2, 0, 0, 1);
+    ps->p += 2;
+    return 0;
+  }
+
+  index = find_func(ps->p, len);
+  if(index >= 0) {
+    ps->p += len;
+    if(expect(ps, '(') || parse_sum(ps))
+      return -1;
+    if(funcs[index].args == 2 && (expect(ps, ',') || parse_sum(ps)))
+      return -1;
+    if(expect(ps, ')'))
+      return -1;
+    emit(ps, funcs[index].op, 0, 0, 1 - funcs[index].args);
+    return 0;
+  }
+
+  index = vc_gdm70x_expr_find(ps->expr_p, ps->p, len);
+  if(index < 0)
+    return -1;
+
+  ps->p += len;
+  emit(ps, VC_GDM70X_EXPR_LOAD, index, 0, 1);
+  return 0;
+}
+
+static int
+parse_unary(struct parser* ps)
+{
+  skip_space(ps);
+
+  if(*ps->p == '-') {
+    ps->p++;
+    if(parse_unary(ps))
+      return -1;
+    emit(ps, VC_GDM70X_EXPR_NEG, 0, 0, 0);
+    return 0;
+  }
+
+  if(*ps->p == '+') {
+    ps->p++;
+    return parse_unary(ps);
+  }
+
+  return parse_primary(ps);
+}
+
+static int
+parse_product(struct parser* ps)
+{
+  char c;
+
+  if(parse_unary(ps))
+    return -1;
+
+  for(;;) {
+    skip_space(ps);
+    c = *ps->p;
+    if(c != '*' && c != '/')
+      return 0;
+
+    ps->p++;
+    if(parse_unary(ps))
+      return -1;
+    emit(ps, (c == '*') ? VC_GDM70X_EXPR_MUL : VC_GDM70X_EXPR_DIV, 0, 0, -1);
+  }
+}
+
+static int
+parse_sum(struct parser* ps)
+{
+  char c;
+
+  if(parse_product(ps))
+    return -1;
+
+  for(;;) {
+    skip_space(ps);
+    c = *ps->p;
+    if(c != '+' && c != '-')
+      return 0;
+
+    ps->p++;
+    if(parse_product(ps))
+      return -1;
+    emit(ps, (c == '+') ? VC_GDM70X_EXPR_ADD : VC_GDM70X_EXPR_SUB, 0, 0, -1);
+  }
+}
+
+struct vc_gdm70x_expr*
+vc_gdm70x_expr_create(void)
+{
+  struct vc_gdm70x_expr* expr_p;
+
+  expr_p = malloc(sizeof(struct vc_gdm70x_expr));
+  if(!expr_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_expr_create: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(expr_p, 0, sizeof(struct vc_gdm70x_expr));
+
+  return expr_p;
+}
+
+void
+vc_gdm70x_expr_destroy(struct vc_gdm70x_expr* expr_p)
+{
+  free(expr_p);
+}
+
+int
+vc_gdm70x_expr_find(const struct vc_gdm70x_expr* expr_p, const char* name, size_t len)
+{
+  int i;
+
+  assert(expr_p);
+  assert(name);
+
+  for(i = 0; i < expr_p->count; i++)
+    if(expr_p->def[i].channel == 0 && strlen(expr_p->def[i].name) == len &&
+       !strncmp(expr_p->def[i].name, name, len))
+      return i;
+
+  return -1;
+}
+
+int
+vc_gdm70x_expr_parse(struct vc_gdm70x_expr* expr_p, const char* spec, int calib)
+{
+  struct vc_gdm70x_expr_def* def_p;
+  struct parser ps;
+  size_t len;
+  int channel = 0;
+
+  assert(expr_p);
+  assert(spec);
+
+  if(expr_p->count == VC_GDM70X_EXPR_COUNT) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_expr_parse: too many expressions.\n",stderr);
+    return -1;
+  }
+
+  while(isspace((unsigned char) *spec))
+    spec++;
+
+  len = name_length(spec);
+
+  if(len == 2 && spec[0] == 'D' && (spec[1] == '1' || spec[1] == '2'))
+    channel = spec[1] - '0';
+
+  if(len == 0 || len >= VC_GDM70X_EXPR_NAME || (calib != 0) != (channel != 0) ||
+     find_func(spec, len) >= 0 || vc_gdm70x_expr_find(expr_p, spec, len) >= 0) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_expr_parse: invalid name.\n",stderr);
+    return -1;
+  }
+
+  def_p = expr_p->def + expr_p->count;
+  memset(def_p, 0, sizeof(struct vc_gdm70x_expr_def));
+  memcpy(def_p->name, spec, len);
+  def_p->channel = channel;
+
+  memset(&ps, 0, sizeof(ps));
+  ps.p = spec + len;
+  ps.expr_p = expr_p;
+  ps.def_p = def_p;
+
+  if(expect(&ps, '=') || parse_sum(&ps))
+    ps.error = 1;
+
+  skip_space(&ps);
+
+  if(ps.error || *ps.p) {
+    if(vc_gdm70x_verbose)
+      fprintf(stderr,"vc_gdm70x_expr_parse: error at '%s'.\n", ps.p);
+    return -1;
+  }
+
+  expr_p->count++;
+
+  return 0;
+}
+
+/* expr_store: store a calibrated value keeping the multiplier */
+static void
+expr_store(struct vc_gdm70x_data* data_p, double value)
+{
+  struct vc_gdm70x_data unit;
+
+  if(value != value) {
+    data_p->mult = OVER;
+    return;
+  }
+
+  unit.value = 1;
+  unit.mult = data_p->mult;
+  data_p->value = value / vc_gdm70x_data_si(&unit);
+}
+
+/* expr_run: evaluate the expressions for a record, skipping the
+   calibrations if derived_only is set */
+static void
+expr_run(struct vc_gdm70x_expr* expr_p, struct vc_gdm70x_record* rec_p,
+	 int derived_only)
+{
+  const struct vc_gdm70x_expr_insn* insn_p;
+  const struct vc_gdm70x_expr_insn* end_p;
+  double stack[VC_GDM70X_EXPR_STACK];
+  double* sp;
+  int i;
+
+  for(i = 0; i < expr_p->count; i++) {
+    if(derived_only && expr_p->def[i].channel != 0)
+      continue;
+
+    sp = stack;
+    insn_p = expr_p->def[i].code;
+    end_p = insn_p + expr_p->def[i].length;
+
+    for(; insn_p < end_p; insn_p++)
+      switch(insn_p->op) {
+      case VC_GDM70X_EXPR_CONST: *sp++ = insn_p->value; break;
+      case VC_GDM70X_EXPR_D1:    *sp++ = vc_gdm70x_data_si(&(rec_p->data1)); break;
+      case VC_GDM70X_EXPR_D2:    *sp++ = vc_gdm70x_data_si(&(rec_p->data2)); break;
+      case VC_GDM70X_EXPR_LOAD:  *sp++ = expr_p->value[insn_p->arg]; break;
+      case VC_GDM70X_EXPR_ADD:   sp--; sp[-1] += sp[0]; break;
+      case VC_GDM70X_EXPR_SUB:   sp--; sp[-1] -= sp[0]; break;
+      case VC_GDM70X_EXPR_MUL:   sp--; sp[-1] *= sp[0]; break;
+      case VC_GDM70X_EXPR_DIV:   sp--; sp[-1] /= sp[0]; break;
+      case VC_GDM70X_EXPR_NEG:   sp[-1] = -sp[-1]; break;
+      case VC_GDM70X_EXPR_ABS:   if(sp[-1] < 0) sp[-1] = -sp[-1]; break;
+      case VC_GDM70X_EXPR_MIN:   sp--; if(sp[0] < sp[-1]) sp[-1] = sp[0]; break;
+      case VC_GDM70X_EXPR_MAX:   sp--; if(sp[0] > sp[-1]) sp[-1] = sp[0]; break;
+      }
+
+    expr_p->value[i] = stack[0];
+
+    if(expr_p->def[i].channel == 1)
+      expr_store(&(rec_p->data1), stack[0]);
+    else if(expr_p->def[i].channel == 2)
+      expr_store(&(rec_p->data2), stack[0]);
+  }
+}
+
+void
+vc_gdm70x_expr_eval(struct vc_gdm70x_expr* expr_p, struct vc_gdm70x_record* rec_p)
+{
+  assert(expr_p);
+  assert(rec_p);
+
+  expr_run(expr_p, rec_p, 0);
+}
+
+void
+vc_gdm70x_expr_derive(struct vc_gdm70x_expr* expr_p,
+		      const struct vc_gdm70x_record* rec_p)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(expr_p);
+  assert(rec_p);
+
+  rec = *rec_p;
+  expr_run(expr_p, &rec, 1);
+}
+
+int
+vc_gdm70x_expr_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+  vc_gdm70x_expr_eval((struct vc_gdm70x_expr*) ptr, &rec);
+
+  gdm_p->data1 = rec.data1;
+  gdm_p->data2 = rec.data2;
+
+  return 0;
+}
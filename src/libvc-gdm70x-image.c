@@ -0,0 +1,164 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/* The delta of two images is the xor of both bitmaps, run length encoded
+   with a control byte followed by data:
+
+     0x00 - 0x7f  literal, (c + 1) bytes of xor data follow
+     0x80 - 0xff  run of (c - 0x7f) zero bytes, no data follows
+
+   Unchanged screen regions collapse to a few bytes this way. */
+
+unsigned long long
+vc_gdm70x_image_fingerprint(const unsigned char* image)
+{
+  unsigned long long fp = 0xcbf29ce484222325ULL; /* FNV-1a */
+  int i;
+
+  assert(image);
+
+  for(i = 0; i < VC_GDM70X_IMAGE_SIZE; i++) {
+    fp ^= image[i];
+    fp *= 0x100000001b3ULL;
+  }
+
+  return fp;
+}
+
+int
+vc_gdm70x_image_delta(const unsigned char* key, const unsigned char* image,
+		      unsigned char* buf)
+{
+  int i = 0, n = 0, run, lit;
+
+  assert(key);
+  assert(image);
+  assert(buf);
+
+  while(i < VC_GDM70X_IMAGE_SIZE) {
+    for(run = 0; (i + run < VC_GDM70X_IMAGE_SIZE) && (run < 128) &&
+	  (key[i + run] == image[i + run]); run++);
+
+    if(run > 0) {
+      buf[n++] = 0x7f + run;
+      i += run;
+      continue;
+    }
+
+    /* literal until two unchanged bytes follow, so a single equal byte
+       does not split the literal */
+    for(lit = 0; (i + lit < VC_GDM70X_IMAGE_SIZE) && (lit < 128); lit++)
+      if( (i + lit + 1 < VC_GDM70X_IMAGE_SIZE) &&
+	  (key[i + lit] == image[i + lit]) &&
+	  (key[i + lit + 1] == image[i + lit + 1]))
+	break;
+
+    buf[n++] = lit - 1;
+    for(; lit > 0; lit--, i++)
+      buf[n++] = key[i] ^ image[i];
+  }
+
+  assert(n <= VC_GDM70X_DELTA_MAX);
+
+  return n;
+}
+
+int
+vc_gdm70x_image_undelta(const unsigned char* key, const unsigned char* delta,
+			int size, unsigned char* image)
+{
+  int i = 0, n = 0, c;
+
+  assert(key);
+  assert(delta);
+  assert(image);
+
+  while(n < size) {
+    c = delta[n++];
+
+    if(c & 0x80) {
+      c -= 0x7f;
+      if(i + c > VC_GDM70X_IMAGE_SIZE)
+	break;
+      memcpy(image + i, key + i, c);
+      i += c;
+    } else {
+      c += 1;
+      if( (i + c > VC_GDM70X_IMAGE_SIZE) || (n + c > size))
+	break;
+      for(; c > 0; c--, i++)
+	image[i] = key[i] ^ delta[n++];
+    }
+  }
+
+  if( (n != size) || (i != VC_GDM70X_IMAGE_SIZE)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_image_undelta: corrupt delta.\n",stderr);
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+vc_gdm70x_image_write_xpm(FILE* fp, const unsigned char* image)
+{
+  int i;
+
+  assert(fp);
+  assert(image);
+
+  fputs("/* XPM */\nstatic char* gdm70x[] = {\n \"128 64 2 1\",\n\"  c white\",\n\"O c black\"",fp);
+  for(i = 0; i< VC_GDM70X_IMAGE_SIZE * 8; i++) {
+    if( (i%128) == 0)
+      fputs(",\n\"",fp);
+    if( image[i/8] & (0x80 >> (i%8)))
+      fputc('O',fp);
+    else
+      fputc(' ',fp);
+
+    if((i % 128) == 127)
+      fputc('"',fp);
+  }
+  fputs("\n};",fp);
+
+  return ferror(fp) ? -1 : 0;
+}
+
+int
+vc_gdm70x_image_write_pbm(FILE* fp, const unsigned char* image)
+{
+  assert(fp);
+  assert(image);
+
+  /* the bitmap is stored row by row, msb first, set bits are black:
+     exactly the raster of a raw pbm */
+  fputs("P4\n128 64\n",fp);
+  fwrite(image,1,VC_GDM70X_IMAGE_SIZE,fp);
+
+  return ferror(fp) ? -1 : 0;
+}
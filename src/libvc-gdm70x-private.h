@@ -0,0 +1,80 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __LIBVC_GDM70X_PRIVATE__
+#define __LIBVC_GDM70X_PRIVATE__
+
+/* helpers shared by the library modules, not installed */
+
+#include <stdint.h>
+#include <time.h>
+
+/* all file formats of the library are stored little endian */
+
+static inline void
+vc_gdm70x_put16(unsigned char* p, uint16_t v)
+{
+  p[0] = v; p[1] = v >> 8;
+}
+
+static inline void
+vc_gdm70x_put32(unsigned char* p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static inline void
+vc_gdm70x_put64(unsigned char* p, uint64_t v)
+{
+  vc_gdm70x_put32(p, v); vc_gdm70x_put32(p + 4, v >> 32);
+}
+
+static inline uint16_t
+vc_gdm70x_get16(const unsigned char* p)
+{
+  return p[0] | (uint16_t) p[1] << 8;
+}
+
+static inline uint32_t
+vc_gdm70x_get32(const unsigned char* p)
+{
+  return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint64_t
+vc_gdm70x_get64(const unsigned char* p)
+{
+  return vc_gdm70x_get32(p) | (uint64_t) vc_gdm70x_get32(p + 4) << 32;
+}
+
+struct vc_gdm70x;
+struct vc_gdm70x_capture;
+
+/* capture files, see libvc-gdm70x-capture.c */
+
+extern void vc_gdm70x_capture_close(struct vc_gdm70x_capture* cap_p);
+extern int vc_gdm70x_capture_write(struct vc_gdm70x_capture* cap_p,
+				   const void* buf, int size);
+extern int vc_gdm70x_capture_read(struct vc_gdm70x_capture* cap_p,
+				  void* buf, int size);
+extern int vc_gdm70x_capture_pending(const struct vc_gdm70x_capture* cap_p);
+extern void vc_gdm70x_capture_time(const struct vc_gdm70x_capture* cap_p,
+				   struct timespec* ts);
+
+#endif
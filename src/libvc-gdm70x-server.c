@@ -0,0 +1,469 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-server.h"
+#include "vc-gdm70x-sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* number of queued messages sent with a single sendmsg */
+#define SERVER_IOV 16
+
+static void
+message_release(struct vc_gdm70x_message* msg_p)
+{
+  if(--msg_p->refs == 0)
+    free(msg_p);
+}
+
+static void
+server_drop(struct vc_gdm70x_server* srv_p, int n, const char* reason)
+{
+  struct vc_gdm70x_client* client_p = srv_p->client + n;
+
+  if(vc_gdm70x_verbose > 1)
+    fprintf(stderr,"vc_gdm70x_server: client dropped, %s.\n",reason);
+
+  close(client_p->fd);
+
+  for(; client_p->count > 0; client_p->count--) {
+    message_release(client_p->queue[client_p->head]);
+    client_p->head = (client_p->head + 1) % VC_GDM70X_SERVER_QUEUE;
+  }
+
+  /* keep the client array dense */
+  *client_p = srv_p->client[--srv_p->clients];
+}
+
+/* server_send: send as much queued data as possible without blocking,
+   returns -1 if the client got dropped */
+static int
+server_send(struct vc_gdm70x_server* srv_p, int n)
+{
+  struct vc_gdm70x_client* client_p = srv_p->client + n;
+  struct vc_gdm70x_message* msg_p;
+  struct iovec iov[SERVER_IOV];
+  struct msghdr msg;
+  unsigned int i, count;
+  ssize_t bytes;
+
+  while(client_p->count > 0) {
+    count = (client_p->count < SERVER_IOV) ? client_p->count : SERVER_IOV;
+
+    for(i = 0; i < count; i++) {
+      msg_p = client_p->queue[(client_p->head + i) % VC_GDM70X_SERVER_QUEUE];
+      iov[i].iov_base = msg_p->data;
+      iov[i].iov_len  = msg_p->size;
+    }
+
+    iov[0].iov_base = (char*) iov[0].iov_base + client_p->offset;
+    iov[0].iov_len -= client_p->offset;
+
+    memset(&msg,0,sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    bytes = sendmsg(client_p->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if(bytes < 0) {
+      if(errno == EINTR)
+	continue;
+      if( (errno == EAGAIN) || (errno == EWOULDBLOCK))
+	return 0;
+      server_drop(srv_p, n, "send failed");
+      return -1;
+    }
+
+    bytes += client_p->offset;
+
+    while( (client_p->count > 0) &&
+	   ((size_t) bytes >= client_p->queue[client_p->head]->size)) {
+      msg_p = client_p->queue[client_p->head];
+      bytes -= msg_p->size;
+      message_release(msg_p);
+      client_p->head = (client_p->head + 1) % VC_GDM70X_SERVER_QUEUE;
+      client_p->count--;
+    }
+
+    client_p->offset = bytes;
+
+    if(client_p->offset > 0)
+      return 0; /* socket buffer is full */
+  }
+
+  return 0;
+}
+
+static void
+server_accept(struct vc_gdm70x_server* srv_p)
+{
+  struct vc_gdm70x_client* client_p;
+  int fd;
+
+  while( (fd = accept(srv_p->fd, NULL, NULL)) >= 0) {
+    if(srv_p->clients == srv_p->max_clients) {
+      client_p = realloc(srv_p->client, (srv_p->max_clients + 16) *
+			 sizeof(struct vc_gdm70x_client));
+      if(!client_p) {
+	if(vc_gdm70x_verbose)
+	  fputs("vc_gdm70x_server: realloc failed.\n",stderr);
+	close(fd);
+	continue;
+      }
+      srv_p->client = client_p;
+      srv_p->max_clients += 16;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    client_p = srv_p->client + srv_p->clients++;
+    memset(client_p,0,sizeof(struct vc_gdm70x_client));
+    client_p->fd = fd;
+
+    if(vc_gdm70x_verbose > 1)
+      fputs("vc_gdm70x_server: client connected.\n",stderr);
+  }
+}
+
+struct vc_gdm70x_server*
+vc_gdm70x_server_open(const char* address, int type)
+{
+  struct vc_gdm70x_server* srv_p;
+  struct sockaddr_un sun;
+  struct sockaddr_in sin;
+  int one = 1;
+
+  assert(address);
+
+  srv_p = malloc(sizeof(struct vc_gdm70x_server));
+  if(!srv_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_server_open: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(srv_p,0,sizeof(struct vc_gdm70x_server));
+  srv_p->type = type;
+  srv_p->max_queue = VC_GDM70X_SERVER_QUEUE;
+
+  if(strncmp(address,"unix:",5) == 0) {
+    memset(&sun,0,sizeof(sun));
+    sun.sun_family = AF_UNIX;
+
+    if(strlen(address + 5) >= sizeof(sun.sun_path)) {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_server_open: socket path too long.\n",stderr);
+      free(srv_p);
+      return 0;
+    }
+
+    strcpy(sun.sun_path, address + 5);
+    srv_p->path = strdup(address + 5);
+    unlink(sun.sun_path);
+
+    srv_p->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( (srv_p->fd >= 0) && bind(srv_p->fd, (struct sockaddr*) &sun, sizeof(sun))) {
+      close(srv_p->fd);
+      srv_p->fd = -1;
+    }
+  } else if(strncmp(address,"tcp:",4) == 0) {
+    memset(&sin,0,sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(address + 4));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    srv_p->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(srv_p->fd >= 0) {
+      setsockopt(srv_p->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if(bind(srv_p->fd, (struct sockaddr*) &sin, sizeof(sin))) {
+	close(srv_p->fd);
+	srv_p->fd = -1;
+      }
+    }
+  } else {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_server_open: invalid address.\n",stderr);
+    free(srv_p);
+    return 0;
+  }
+
+  if( (srv_p->fd < 0) || listen(srv_p->fd, 16)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_server_open: socket failed");
+    if(srv_p->fd >= 0)
+      close(srv_p->fd);
+    free(srv_p->path);
+    free(srv_p);
+    return 0;
+  }
+
+  fcntl(srv_p->fd, F_SETFL, fcntl(srv_p->fd, F_GETFL) | O_NONBLOCK);
+  fcntl(srv_p->fd, F_SETFD, FD_CLOEXEC);
+
+  return srv_p;
+}
+
+void
+vc_gdm70x_server_close(struct vc_gdm70x_server* srv_p)
+{
+  assert(srv_p);
+
+  while(srv_p->clients > 0)
+    server_drop(srv_p, srv_p->clients - 1, "server closed");
+
+  close(srv_p->fd);
+
+  if(srv_p->path)
+    unlink(srv_p->path);
+
+  free(srv_p->path);
+  free(srv_p->client);
+  free(srv_p);
+}
+
+void
+vc_gdm70x_server_setqueue(struct vc_gdm70x_server* srv_p, int count)
+{
+  assert(srv_p);
+
+  if(count < 1)
+    count = 1;
+  if(count > VC_GDM70X_SERVER_QUEUE)
+    count = VC_GDM70X_SERVER_QUEUE;
+
+  srv_p->max_queue = count;
+}
+
+int
+vc_gdm70x_server_publish(struct vc_gdm70x_server* srv_p, const void* data, size_t size)
+{
+  struct vc_gdm70x_message* msg_p;
+  struct vc_gdm70x_client* client_p;
+  int i;
+
+  assert(srv_p);
+  assert(data);
+
+  server_accept(srv_p);
+
+  if( (srv_p->clients == 0) || (size == 0))
+    return 0;
+
+  msg_p = malloc(sizeof(struct vc_gdm70x_message) + size);
+  if(!msg_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_server_publish: malloc failed.\n",stderr);
+    return -1;
+  }
+
+  memcpy(msg_p->data, data, size);
+  msg_p->size = size;
+  msg_p->refs = 1; /* held until queued everywhere */
+
+  for(i = 0; i < srv_p->clients; ) {
+    client_p = srv_p->client + i;
+
+    if(client_p->count >= (unsigned int) srv_p->max_queue) {
+      server_drop(srv_p, i, "too slow");
+      continue;
+    }
+
+    client_p->queue[(client_p->head + client_p->count) % VC_GDM70X_SERVER_QUEUE] = msg_p;
+    client_p->count++;
+    msg_p->refs++;
+
+    if(server_send(srv_p, i) == 0)
+      i++;
+  }
+
+  message_release(msg_p);
+
+  return 0;
+}
+
+int
+vc_gdm70x_server_publish_record(struct vc_gdm70x_server* srv_p,
+				const struct vc_gdm70x_record* rec_p)
+{
+  char buf[512];
+  int n;
+
+  assert(srv_p);
+  assert(rec_p);
+
+  n = vc_gdm70x_format_record(srv_p->type, rec_p, buf, sizeof(buf));
+  if(n < 0)
+    return -1;
+
+  return vc_gdm70x_server_publish(srv_p, buf, n);
+}
+
+int
+vc_gdm70x_server_publish_image(struct vc_gdm70x_server* srv_p,
+			       const struct timespec* ts, const unsigned char* image)
+{
+  static const char hex[] = "0123456789abcdef";
+  char buf[64 + 2 * VC_GDM70X_IMAGE_SIZE];
+  int i, n;
+
+  assert(srv_p);
+  assert(ts);
+  assert(image);
+
+  if(srv_p->type != VC_GDM70X_SINK_JSONL)
+    return 0;
+
+  n = sprintf(buf, "{\"ts\":%lld.%09ld,\"image\":\"",
+	      (long long) ts->tv_sec, (long) ts->tv_nsec);
+
+  for(i = 0; i < VC_GDM70X_IMAGE_SIZE; i++) {
+    buf[n++] = hex[image[i] >> 4];
+    buf[n++] = hex[image[i] & 0x0f];
+  }
+
+  n += sprintf(buf + n, "\"}\n");
+
+  return vc_gdm70x_server_publish(srv_p, buf, n);
+}
+
+int
+vc_gdm70x_server_wait(struct vc_gdm70x_server* srv_p, int fd, int timeout)
+{
+  struct pollfd *pfd, *pfd_new;
+  struct timespec now, end;
+  char buf[256];
+  int i, n, nfds, ms, retval = 0;
+
+  assert(srv_p);
+
+  pfd = malloc((srv_p->clients + 2) * sizeof(struct pollfd));
+  if(!pfd) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_server_wait: malloc failed.\n",stderr);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  end.tv_sec  += timeout / 1000;
+  end.tv_nsec += (timeout % 1000) * 1000000L;
+  if(end.tv_nsec >= 1000000000L) {
+    end.tv_sec++;
+    end.tv_nsec -= 1000000000L;
+  }
+
+  for(;;) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (end.tv_sec - now.tv_sec) * 1000 + (end.tv_nsec - now.tv_nsec) / 1000000;
+    if(ms < 0)
+      ms = 0;
+
+    nfds = srv_p->clients;
+    for(i = 0; i < nfds; i++) {
+      pfd[i].fd = srv_p->client[i].fd;
+      pfd[i].events = POLLIN | (srv_p->client[i].count ? POLLOUT : 0);
+      pfd[i].revents = 0;
+    }
+
+    pfd[nfds].fd = srv_p->fd;
+    pfd[nfds].events = POLLIN;
+    pfd[nfds].revents = 0;
+
+    pfd[nfds + 1].fd = fd;
+    pfd[nfds + 1].events = POLLIN;
+    pfd[nfds + 1].revents = 0;
+
+    n = poll(pfd, nfds + 2, ms);
+
+    if(n < 0) {
+      if(errno == EINTR)
+	break;
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_server_wait: poll failed");
+      retval = -1;
+      break;
+    }
+
+    /* walk backwards, dropping a client moves the last one */
+    for(i = nfds - 1; i >= 0; i--) {
+      if(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+	/* clients are not expected to send anything */
+	n = read(srv_p->client[i].fd, buf, sizeof(buf));
+	if( (n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+	  server_drop(srv_p, i, "disconnected");
+	  continue;
+	}
+      }
+
+      if(pfd[i].revents & POLLOUT)
+	server_send(srv_p, i);
+    }
+
+    if(pfd[nfds].revents & POLLIN) {
+      server_accept(srv_p);
+
+      pfd_new = realloc(pfd, (srv_p->clients + 2) * sizeof(struct pollfd));
+      if(!pfd_new) {
+	retval = -1;
+	break;
+      }
+      pfd = pfd_new;
+    }
+
+    if( (fd >= 0) && (pfd[nfds + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+      retval = 1;
+      break;
+    }
+
+    if(ms == 0)
+      break;
+  }
+
+  free(pfd);
+
+  return retval;
+}
+
+int
+vc_gdm70x_server_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  return vc_gdm70x_server_publish_record(ptr, &rec);
+}
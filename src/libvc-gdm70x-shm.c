@@ -0,0 +1,308 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static struct vc_gdm70x_shm*
+shm_map(const char* name, int writer)
+{
+  struct vc_gdm70x_shm* shm_p;
+  size_t size = sizeof(struct vc_gdm70x_shm_segment);
+  struct stat st;
+
+  shm_p = malloc(sizeof(struct vc_gdm70x_shm));
+  if(!shm_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_shm: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  shm_p->writer = writer;
+  shm_p->fd = shm_open(name, writer ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if(shm_p->fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_shm: shm_open failed");
+    free(shm_p);
+    return 0;
+  }
+
+  if(writer && ftruncate(shm_p->fd, size)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_shm: ftruncate failed");
+    goto fail;
+  }
+
+  if(!writer && (fstat(shm_p->fd, &st) || (size_t) st.st_size < size)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_shm: segment too small.\n",stderr);
+    goto fail;
+  }
+
+  shm_p->seg = mmap(0, size, writer ? (PROT_READ | PROT_WRITE) : PROT_READ,
+		    MAP_SHARED, shm_p->fd, 0);
+  if(shm_p->seg == MAP_FAILED) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_shm: mmap failed");
+    goto fail;
+  }
+
+  return shm_p;
+
+fail:
+  close(shm_p->fd);
+  free(shm_p);
+  return 0;
+}
+
+struct vc_gdm70x_shm*
+vc_gdm70x_shm_create(const char* name)
+{
+  struct vc_gdm70x_shm* shm_p;
+  struct vc_gdm70x_shm_segment* seg;
+
+  assert(name);
+
+  shm_p = shm_map(name, 1);
+  if(!shm_p)
+    return 0;
+
+  seg = shm_p->seg;
+
+  /* readers of a reused segment keep their mapping and see the new
+     writer, the counters just go on */
+  if(seg->magic != VC_GDM70X_SHM_MAGIC || seg->version != VC_GDM70X_SHM_VERSION ||
+     seg->size != sizeof(struct vc_gdm70x_shm_segment)) {
+    memset(seg, 0, sizeof(struct vc_gdm70x_shm_segment));
+    seg->version = VC_GDM70X_SHM_VERSION;
+    seg->size = sizeof(struct vc_gdm70x_shm_segment);
+    __atomic_store_n(&(seg->magic), VC_GDM70X_SHM_MAGIC, __ATOMIC_RELEASE);
+  }
+
+  /* a writer killed while publishing leaves an odd counter */
+  seg->seq &= ~1U;
+  seg->image_seq &= ~1U;
+  __atomic_store_n(&(seg->writer), (int) getpid(), __ATOMIC_RELEASE);
+
+  return shm_p;
+}
+
+struct vc_gdm70x_shm*
+vc_gdm70x_shm_open(const char* name)
+{
+  struct vc_gdm70x_shm* shm_p;
+  struct vc_gdm70x_shm_segment* seg;
+
+  assert(name);
+
+  shm_p = shm_map(name, 0);
+  if(!shm_p)
+    return 0;
+
+  seg = shm_p->seg;
+
+  if(__atomic_load_n(&(seg->magic), __ATOMIC_ACQUIRE) != VC_GDM70X_SHM_MAGIC ||
+     seg->version != VC_GDM70X_SHM_VERSION ||
+     seg->size != sizeof(struct vc_gdm70x_shm_segment)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_shm_open: incompatible segment.\n",stderr);
+    vc_gdm70x_shm_close(shm_p);
+    return 0;
+  }
+
+  return shm_p;
+}
+
+void
+vc_gdm70x_shm_close(struct vc_gdm70x_shm* shm_p)
+{
+  if(!shm_p)
+    return;
+
+  if(shm_p->writer)
+    __atomic_store_n(&(shm_p->seg->writer), 0, __ATOMIC_RELEASE);
+
+  munmap(shm_p->seg, sizeof(struct vc_gdm70x_shm_segment));
+  close(shm_p->fd);
+  free(shm_p);
+}
+
+/* the writer makes the counter odd before and even after the update */
+
+static unsigned int
+shm_begin(unsigned int* seq)
+{
+  unsigned int s = *seq;
+
+  __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return s;
+}
+
+static void
+shm_end(unsigned int* seq, unsigned int s)
+{
+  __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+}
+
+void
+vc_gdm70x_shm_publish(struct vc_gdm70x_shm* shm_p,
+		      const struct vc_gdm70x_record* rec_p)
+{
+  struct vc_gdm70x_shm_segment* seg;
+  unsigned int s;
+
+  assert(shm_p);
+  assert(shm_p->writer);
+  assert(rec_p);
+
+  seg = shm_p->seg;
+
+  s = shm_begin(&(seg->seq));
+  seg->rec = *rec_p;
+  seg->count++;
+  shm_end(&(seg->seq), s);
+}
+
+void
+vc_gdm70x_shm_publish_image(struct vc_gdm70x_shm* shm_p,
+			    const struct timespec* ts, const unsigned char* image)
+{
+  struct vc_gdm70x_shm_segment* seg;
+  unsigned int s;
+
+  assert(shm_p);
+  assert(shm_p->writer);
+  assert(ts);
+  assert(image);
+
+  seg = shm_p->seg;
+
+  s = shm_begin(&(seg->image_seq));
+  seg->image_ts = *ts;
+  memcpy(seg->image, image, VC_GDM70X_IMAGE_SIZE);
+  seg->image_count++;
+  shm_end(&(seg->image_seq), s);
+}
+
+int
+vc_gdm70x_shm_read(const struct vc_gdm70x_shm* shm_p,
+		   struct vc_gdm70x_record* rec_p, unsigned long long* count)
+{
+  const struct vc_gdm70x_shm_segment* seg;
+  unsigned long long c;
+  unsigned int s;
+  int i;
+
+  assert(shm_p);
+  assert(rec_p);
+
+  seg = shm_p->seg;
+
+  for(i = 0; i < VC_GDM70X_SHM_RETRIES; i++) {
+    s = __atomic_load_n(&(seg->seq), __ATOMIC_ACQUIRE);
+    if(s & 1)
+      continue;
+
+    *rec_p = seg->rec;
+    c = seg->count;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&(seg->seq), __ATOMIC_RELAXED) == s) {
+      if(count)
+	*count = c;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int
+vc_gdm70x_shm_read_image(const struct vc_gdm70x_shm* shm_p, struct timespec* ts,
+			 unsigned char* image, unsigned long long* count)
+{
+  const struct vc_gdm70x_shm_segment* seg;
+  unsigned long long c;
+  unsigned int s;
+  int i;
+
+  assert(shm_p);
+  assert(ts);
+  assert(image);
+
+  seg = shm_p->seg;
+
+  for(i = 0; i < VC_GDM70X_SHM_RETRIES; i++) {
+    s = __atomic_load_n(&(seg->image_seq), __ATOMIC_ACQUIRE);
+    if(s & 1)
+      continue;
+
+    *ts = seg->image_ts;
+    memcpy(image, seg->image, VC_GDM70X_IMAGE_SIZE);
+    c = seg->image_count;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&(seg->image_seq), __ATOMIC_RELAXED) == s) {
+      if(count)
+	*count = c;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+int
+vc_gdm70x_shm_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+  vc_gdm70x_shm_publish((struct vc_gdm70x_shm*) ptr, &rec);
+
+  return 0;
+}
+
+int
+vc_gdm70x_shm_image_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  assert(gdm_p);
+  assert(ptr);
+
+  if(gdm_p->image)
+    vc_gdm70x_shm_publish_image((struct vc_gdm70x_shm*) ptr, &(gdm_p->ts),
+				gdm_p->image);
+
+  return 0;
+}
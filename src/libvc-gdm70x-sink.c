@@ -0,0 +1,497 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-sink.h"
+#include "libvc-gdm70x-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* Binary record files start with the magic "GDM70XR\0", u32 version and
+   u32 record size. Each record is stored little endian as
+
+     u64 sec, u32 nsec,
+     f32 value1, u8 unit1, u8 mult1, u16 reserved,
+     f32 value2, u8 unit2, u8 mult2, u16 reserved,
+     u32 reserved */
+
+static const char record_magic[8] = "GDM70XR";
+
+const char*
+vc_gdm70x_unit_name(enum vc_unit unit)
+{
+  switch(unit) {
+  case VAC:    return "VAC";
+  case VDC:    return "VDC";
+  case AAC:    return "AAC";
+  case ADC:    return "ADC";
+  case OHM:    return "OHM";
+  case FARAD:  return "FARAD";
+  case HERZ:   return "HERZ";
+  case LOGIC:  return "LOGIC";
+  case DIODE:  return "DIODE";
+  case TEMP_C: return "TEMP_C";
+  case TEMP_F: return "TEMP_F";
+  case RH:     return "RH";
+  case PASCAL: return "PASCAL";
+  case PSI:    return "PSI";
+  default:     return "UNKNOWN";
+  }
+}
+
+static void
+record_packdata(const struct vc_gdm70x_data* data_p, unsigned char* buf)
+{
+  uint32_t v;
+
+  memcpy(&v, &(data_p->value), 4);
+  vc_gdm70x_put32(buf, v);
+  buf[4] = data_p->unit;
+  buf[5] = data_p->mult;
+  buf[6] = buf[7] = 0;
+}
+
+static void
+record_unpackdata(const unsigned char* buf, struct vc_gdm70x_data* data_p)
+{
+  uint32_t v;
+
+  v = vc_gdm70x_get32(buf);
+  memcpy(&(data_p->value), &v, 4);
+  data_p->unit = buf[4];
+  data_p->mult = buf[5];
+}
+
+void
+vc_gdm70x_record_pack(const struct vc_gdm70x_record* rec_p, unsigned char* buf)
+{
+  assert(rec_p);
+  assert(buf);
+
+  vc_gdm70x_put64(buf, rec_p->ts.tv_sec);
+  vc_gdm70x_put32(buf + 8, rec_p->ts.tv_nsec);
+  record_packdata(&(rec_p->data1), buf + 12);
+  record_packdata(&(rec_p->data2), buf + 20);
+  vc_gdm70x_put32(buf + 28, 0);
+}
+
+void
+vc_gdm70x_record_unpack(const unsigned char* buf, struct vc_gdm70x_record* rec_p)
+{
+  assert(rec_p);
+  assert(buf);
+
+  rec_p->ts.tv_sec  = (int64_t) vc_gdm70x_get64(buf);
+  rec_p->ts.tv_nsec = vc_gdm70x_get32(buf + 8);
+  record_unpackdata(buf + 12, &(rec_p->data1));
+  record_unpackdata(buf + 20, &(rec_p->data2));
+}
+
+int
+vc_gdm70x_format_header(int type, char* buf, size_t size)
+{
+  int n;
+
+  assert(buf);
+
+  switch(type) {
+  case VC_GDM70X_SINK_CSV:
+    n = snprintf(buf, size, "time;value1;mult1;unit1;value2;mult2;unit2\n");
+    return (n < 0 || (size_t) n >= size) ? -1 : n;
+  case VC_GDM70X_SINK_JSONL:
+    return 0;
+  case VC_GDM70X_SINK_BINARY:
+    if(size < VC_GDM70X_RECORD_HEADER)
+      return -1;
+    memcpy(buf, record_magic, 8);
+    vc_gdm70x_put32((unsigned char*) buf + 8, 1);
+    vc_gdm70x_put32((unsigned char*) buf + 12, VC_GDM70X_RECORD_SIZE);
+    return VC_GDM70X_RECORD_HEADER;
+  }
+
+  return -1;
+}
+
+/* mult as string, "" for none */
+static const char*
+format_mult(enum vc_mult mult, char* buf)
+{
+  buf[0] = (mult == NONE) ? 0 : mult;
+  buf[1] = 0;
+  return buf;
+}
+
+int
+vc_gdm70x_format_record(int type, const struct vc_gdm70x_record* rec_p,
+			char* buf, size_t size)
+{
+  char m1[2], m2[2];
+  int n = -1;
+
+  assert(rec_p);
+  assert(buf);
+
+  switch(type) {
+  case VC_GDM70X_SINK_CSV:
+    n = snprintf(buf, size, "%lld.%09ld;%g;%s;%s;%g;%s;%s\n",
+		 (long long) rec_p->ts.tv_sec, (long) rec_p->ts.tv_nsec,
+		 rec_p->data1.value, format_mult(rec_p->data1.mult, m1),
+		 vc_gdm70x_unit_name(rec_p->data1.unit),
+		 rec_p->data2.value, format_mult(rec_p->data2.mult, m2),
+		 vc_gdm70x_unit_name(rec_p->data2.unit));
+    break;
+  case VC_GDM70X_SINK_JSONL:
+    n = snprintf(buf, size, "{\"ts\":%lld.%09ld,"
+		 "\"d1\":{\"v\":%g,\"m\":\"%s\",\"u\":\"%s\"},"
+		 "\"d2\":{\"v\":%g,\"m\":\"%s\",\"u\":\"%s\"}}\n",
+		 (long long) rec_p->ts.tv_sec, (long) rec_p->ts.tv_nsec,
+		 rec_p->data1.value, format_mult(rec_p->data1.mult, m1),
+		 vc_gdm70x_unit_name(rec_p->data1.unit),
+		 rec_p->data2.value, format_mult(rec_p->data2.mult, m2),
+		 vc_gdm70x_unit_name(rec_p->data2.unit));
+    break;
+  case VC_GDM70X_SINK_BINARY:
+    if(size < VC_GDM70X_RECORD_SIZE)
+      return -1;
+    vc_gdm70x_record_pack(rec_p, (unsigned char*) buf);
+    return VC_GDM70X_RECORD_SIZE;
+  }
+
+  return (n < 0 || (size_t) n >= size) ? -1 : n;
+}
+
+struct vc_gdm70x_sink*
+vc_gdm70x_sink_create(int type, int fd)
+{
+  struct vc_gdm70x_sink* sink_p;
+  int n;
+
+  if( (type != VC_GDM70X_SINK_CSV) && (type != VC_GDM70X_SINK_JSONL) &&
+      (type != VC_GDM70X_SINK_BINARY)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_sink_create: invalid sink type.\n",stderr);
+    return 0;
+  }
+
+  sink_p = malloc(sizeof(struct vc_gdm70x_sink));
+  if(!sink_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_sink_create: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(sink_p,0,sizeof(struct vc_gdm70x_sink));
+  sink_p->fd = fd;
+  sink_p->type = type;
+  sink_p->flush_size = VC_GDM70X_SINK_BLOCK;
+  sink_p->flush_interval = 1000;
+
+  /* the header is queued as first data */
+  n = vc_gdm70x_format_header(type, sink_p->buf[0], VC_GDM70X_SINK_BLOCK);
+  sink_p->blocks = 1;
+  sink_p->used[0] = sink_p->pending = n;
+
+  if(n > 0)
+    clock_gettime(CLOCK_MONOTONIC, &(sink_p->first));
+
+  return sink_p;
+}
+
+struct vc_gdm70x_sink*
+vc_gdm70x_sink_open(int type, const char* filename)
+{
+  struct vc_gdm70x_sink* sink_p;
+  int fd;
+
+  assert(filename);
+
+  if(strcmp(filename,"-") == 0)
+    return vc_gdm70x_sink_create(type, 1);
+
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if(fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_sink_open: open failed");
+    return 0;
+  }
+
+  sink_p = vc_gdm70x_sink_create(type, fd);
+  if(!sink_p) {
+    close(fd);
+    return 0;
+  }
+
+  sink_p->close_fd = 1;
+
+  return sink_p;
+}
+
+int
+vc_gdm70x_sink_close(struct vc_gdm70x_sink* sink_p)
+{
+  struct vc_gdm70x_sink* next_p;
+  int retval = 0;
+
+  while(sink_p) {
+    next_p = sink_p->next;
+
+    if(vc_gdm70x_sink_flush(sink_p))
+      retval = -1;
+
+    if(sink_p->close_fd && close(sink_p->fd)) {
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_sink_close: close failed");
+      retval = -1;
+    }
+
+    free(sink_p);
+    sink_p = next_p;
+  }
+
+  return retval;
+}
+
+void
+vc_gdm70x_sink_setflush(struct vc_gdm70x_sink* sink_p, size_t size, int interval)
+{
+  assert(sink_p);
+
+  if(size > VC_GDM70X_SINK_BLOCK * VC_GDM70X_SINK_BLOCKS)
+    size = VC_GDM70X_SINK_BLOCK * VC_GDM70X_SINK_BLOCKS;
+
+  sink_p->flush_size = size;
+  sink_p->flush_interval = interval;
+}
+
+int
+vc_gdm70x_sink_flush(struct vc_gdm70x_sink* sink_p)
+{
+  struct iovec iov[VC_GDM70X_SINK_BLOCKS];
+  struct iovec* iov_p = iov;
+  int i, count;
+  ssize_t bytes;
+
+  assert(sink_p);
+
+  if(sink_p->pending == 0)
+    return 0;
+
+  for(i = 0, count = 0; i < sink_p->blocks; i++)
+    if(sink_p->used[i]) {
+      iov[count].iov_base = sink_p->buf[i];
+      iov[count].iov_len  = sink_p->used[i];
+      count++;
+    }
+
+  while(count > 0) {
+    bytes = writev(sink_p->fd, iov_p, count);
+
+    if(bytes < 0) {
+      if(errno == EINTR)
+	continue;
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_sink_flush: writev failed");
+      sink_p->error = errno;
+      break;
+    }
+
+    /* skip what has been written */
+    while( (count > 0) && ((size_t) bytes >= iov_p->iov_len)) {
+      bytes -= iov_p->iov_len;
+      iov_p++;
+      count--;
+    }
+
+    if(count > 0) {
+      iov_p->iov_base = (char*) iov_p->iov_base + bytes;
+      iov_p->iov_len -= bytes;
+    }
+  }
+
+  sink_p->blocks = 1;
+  sink_p->used[0] = 0;
+  sink_p->pending = 0;
+
+  return (count > 0) ? -1 : 0;
+}
+
+/* format_expr: append the derived values to the record of length n in
+   buf, returns the new length, -1 if buf is too small */
+static int
+format_expr(int type, const struct vc_gdm70x_expr* expr_p, char* buf, int n,
+	    size_t size)
+{
+  int i, m;
+
+  /* strip "\n" or "}\n" */
+  n -= (type == VC_GDM70X_SINK_JSONL) ? 2 : 1;
+
+  for(i = 0; i < expr_p->count; i++) {
+    if(expr_p->def[i].channel)
+      continue;
+
+    if(type == VC_GDM70X_SINK_CSV)
+      m = snprintf(buf + n, size - n, ";%g", expr_p->value[i]);
+    else if(!isfinite(expr_p->value[i]))
+      m = snprintf(buf + n, size - n, ",\"%s\":null", expr_p->def[i].name);
+    else
+      m = snprintf(buf + n, size - n, ",\"%s\":%g", expr_p->def[i].name,
+		   expr_p->value[i]);
+
+    if(m < 0 || (size_t) (n + m) >= size)
+      return -1;
+    n += m;
+  }
+
+  m = snprintf(buf + n, size - n, (type == VC_GDM70X_SINK_JSONL) ? "}\n" : "\n");
+
+  return (m < 0 || (size_t) (n + m) >= size) ? -1 : n + m;
+}
+
+int
+vc_gdm70x_sink_setexpr(struct vc_gdm70x_sink* sink_p,
+		       const struct vc_gdm70x_expr* expr_p)
+{
+  int i, n;
+
+  assert(sink_p);
+  assert(expr_p);
+
+  if(sink_p->type == VC_GDM70X_SINK_BINARY) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_sink_setexpr: binary records have no derived values.\n",stderr);
+    return -1;
+  }
+
+  sink_p->expr = expr_p;
+
+  /* extend the queued csv header by the names */
+  if(sink_p->type == VC_GDM70X_SINK_CSV && sink_p->blocks == 1 && sink_p->used[0] > 0) {
+    n = sink_p->used[0] - 1;
+    for(i = 0; i < expr_p->count; i++)
+      if(!expr_p->def[i].channel)
+	n += snprintf(sink_p->buf[0] + n, VC_GDM70X_SINK_BLOCK - n, ";%s",
+		      expr_p->def[i].name);
+    sink_p->buf[0][n++] = '\n';
+    sink_p->pending += n - sink_p->used[0];
+    sink_p->used[0] = n;
+  }
+
+  return 0;
+}
+
+int
+vc_gdm70x_sink_write(struct vc_gdm70x_sink* sink_p, const struct vc_gdm70x_record* rec_p)
+{
+  struct timespec now;
+  int n, i;
+  long ms;
+
+  assert(sink_p);
+  assert(rec_p);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  for(;;) {
+    i = sink_p->blocks - 1;
+    n = vc_gdm70x_format_record(sink_p->type, rec_p, sink_p->buf[i] + sink_p->used[i],
+				VC_GDM70X_SINK_BLOCK - sink_p->used[i]);
+    if(n >= 0 && sink_p->expr)
+      n = format_expr(sink_p->type, sink_p->expr, sink_p->buf[i] + sink_p->used[i],
+		      n, VC_GDM70X_SINK_BLOCK - sink_p->used[i]);
+    if(n >= 0)
+      break;
+
+    if(sink_p->used[i] == 0) {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_sink_write: record too large.\n",stderr);
+      return -1;
+    }
+
+    if(sink_p->blocks == VC_GDM70X_SINK_BLOCKS) {
+      if(vc_gdm70x_sink_flush(sink_p))
+	return -1;
+    } else
+      sink_p->used[sink_p->blocks++] = 0;
+  }
+
+  if(sink_p->pending == 0)
+    sink_p->first = now;
+
+  sink_p->used[i] += n;
+  sink_p->pending += n;
+
+  ms = (now.tv_sec - sink_p->first.tv_sec) * 1000 +
+       (now.tv_nsec - sink_p->first.tv_nsec) / 1000000;
+
+  if( (sink_p->pending >= sink_p->flush_size) || (ms >= sink_p->flush_interval))
+    return vc_gdm70x_sink_flush(sink_p);
+
+  return 0;
+}
+
+int
+vc_gdm70x_sink_flush_due(struct vc_gdm70x_sink* sink_p)
+{
+  struct timespec now;
+  int retval = 0;
+  long ms;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  for(; sink_p; sink_p = sink_p->next) {
+    if(sink_p->pending == 0)
+      continue;
+
+    ms = (now.tv_sec - sink_p->first.tv_sec) * 1000 +
+	 (now.tv_nsec - sink_p->first.tv_nsec) / 1000000;
+
+    if( (ms >= sink_p->flush_interval) && vc_gdm70x_sink_flush(sink_p))
+      retval = -1;
+  }
+
+  return retval;
+}
+
+int
+vc_gdm70x_sink_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_sink* sink_p;
+  struct vc_gdm70x_record rec;
+  int retval = 0;
+
+  assert(gdm_p);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  for(sink_p = ptr; sink_p; sink_p = sink_p->next)
+    if(vc_gdm70x_sink_write(sink_p, &rec))
+      retval = -1;
+
+  return retval;
+}
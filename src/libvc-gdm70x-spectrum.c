@@ -0,0 +1,288 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-spectrum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+struct vc_gdm70x_spectrum*
+vc_gdm70x_spectrum_create(int size, int bins)
+{
+  struct vc_gdm70x_spectrum* spec_p;
+  double* p;
+  int i, c, stride;
+
+  assert(size >= 8);
+
+  if(bins <= 0 || bins > size / 2)
+    bins = size / 2;
+
+  stride = (bins + VC_GDM70X_SPECTRUM_LANES - 1) & ~(VC_GDM70X_SPECTRUM_LANES - 1);
+
+  spec_p = malloc(sizeof(struct vc_gdm70x_spectrum));
+  if(!spec_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_spectrum_create: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(spec_p, 0, sizeof(struct vc_gdm70x_spectrum));
+
+  /* all arrays in one block: cos, sin, time and per channel re, im and
+     the samples */
+  p = malloc(sizeof(double) * (3 * size + 2 * (2 * stride + size)));
+  if(!p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_spectrum_create: malloc failed.\n",stderr);
+    free(spec_p);
+    return 0;
+  }
+
+  spec_p->size = size;
+  spec_p->bins = bins;
+  spec_p->stride = stride;
+  spec_p->interval = size;
+
+  spec_p->cos_n = p; p += size;
+  spec_p->sin_n = p; p += size;
+  spec_p->time  = p; p += size;
+
+  for(c = 0; c < 2; c++) {
+    spec_p->ch[c].re     = p; p += stride;
+    spec_p->ch[c].im     = p; p += stride;
+    spec_p->ch[c].sample = p; p += size;
+  }
+
+  for(i = 0; i < size; i++) {
+    spec_p->cos_n[i] = cos(2 * M_PI * i / size);
+    spec_p->sin_n[i] = sin(2 * M_PI * i / size);
+  }
+
+  vc_gdm70x_spectrum_reset(spec_p);
+
+  return spec_p;
+}
+
+void
+vc_gdm70x_spectrum_destroy(struct vc_gdm70x_spectrum* spec_p)
+{
+  if(!spec_p)
+    return;
+
+  free(spec_p->cos_n);
+  free(spec_p);
+}
+
+void
+vc_gdm70x_spectrum_reset(struct vc_gdm70x_spectrum* spec_p)
+{
+  int c;
+
+  assert(spec_p);
+
+  spec_p->pos = 0;
+  spec_p->count = 0;
+  spec_p->rate = 0;
+
+  memset(spec_p->time, 0, sizeof(double) * spec_p->size);
+
+  for(c = 0; c < 2; c++) {
+    memset(spec_p->ch[c].re, 0, sizeof(double) * spec_p->stride);
+    memset(spec_p->ch[c].im, 0, sizeof(double) * spec_p->stride);
+    memset(spec_p->ch[c].sample, 0, sizeof(double) * spec_p->size);
+    spec_p->ch[c].last = 0;
+    spec_p->ch[c].freq = 0;
+    spec_p->ch[c].amplitude = 0;
+  }
+}
+
+void
+vc_gdm70x_spectrum_setinterval(struct vc_gdm70x_spectrum* spec_p, int count)
+{
+  assert(spec_p);
+  assert(count > 0);
+
+  spec_p->interval = count;
+}
+
+void
+vc_gdm70x_spectrum_setfunc_report(struct vc_gdm70x_spectrum* spec_p,
+				  int (*func) (struct vc_gdm70x_spectrum* spec_p,
+					       const struct vc_gdm70x_record* rec_p,
+					       void* ptr),
+				  void* ptr)
+{
+  assert(spec_p);
+
+  spec_p->func_report = func;
+  spec_p->func_report_ext = ptr;
+}
+
+/* spectrum_slide: add d to all bins and rotate them by 2 pi k / size.
+   The lanes of a step are independent, so they are vectorized even if
+   the loop over all bins is not */
+static void
+spectrum_slide(double* restrict re, double* restrict im,
+	       const double* restrict c, const double* restrict s,
+	       double d, int stride)
+{
+  double r[VC_GDM70X_SPECTRUM_LANES], i[VC_GDM70X_SPECTRUM_LANES];
+  int k, l;
+
+  for(k = 0; k < stride; k += VC_GDM70X_SPECTRUM_LANES) {
+    for(l = 0; l < VC_GDM70X_SPECTRUM_LANES; l++) {
+      r[l] = re[k + l] + d;
+      i[l] = im[k + l];
+    }
+    for(l = 0; l < VC_GDM70X_SPECTRUM_LANES; l++) {
+      re[k + l] = r[l] * c[k + l] - i[l] * s[k + l];
+      im[k + l] = r[l] * s[k + l] + i[l] * c[k + l];
+    }
+  }
+}
+
+/* spectrum_sync: compute all bins of a channel from the samples */
+static void
+spectrum_sync(struct vc_gdm70x_spectrum* spec_p, struct vc_gdm70x_spectrum_channel* ch_p)
+{
+  double x;
+  int k, m, n, size = spec_p->size;
+
+  memset(ch_p->re, 0, sizeof(double) * spec_p->stride);
+  memset(ch_p->im, 0, sizeof(double) * spec_p->stride);
+
+  for(m = 0; m < size; m++) {
+    x = ch_p->sample[(spec_p->pos + m) % size];
+
+    /* n = k * m modulo size */
+    for(k = 0, n = m; k < spec_p->bins; k++) {
+      ch_p->re[k] += x * spec_p->cos_n[n];
+      ch_p->im[k] -= x * spec_p->sin_n[n];
+      n += m;
+      if(n >= size)
+	n -= size;
+    }
+  }
+}
+
+int
+vc_gdm70x_spectrum_peak(struct vc_gdm70x_spectrum* spec_p, int channel)
+{
+  struct vc_gdm70x_spectrum_channel* ch_p;
+  double power, best = -1;
+  int k, bin = 0;
+
+  assert(spec_p);
+  assert(channel == 1 || channel == 2);
+
+  if(spec_p->count < (unsigned long) spec_p->size)
+    return -1;
+
+  ch_p = spec_p->ch + channel - 1;
+
+  for(k = 0; k < spec_p->bins; k++) {
+    power = ch_p->re[k] * ch_p->re[k] + ch_p->im[k] * ch_p->im[k];
+    if(power > best) {
+      best = power;
+      bin = k + 1;
+    }
+  }
+
+  ch_p->freq = bin * spec_p->rate / spec_p->size;
+  ch_p->amplitude = 2 * sqrt(best) / spec_p->size;
+
+  return bin;
+}
+
+int
+vc_gdm70x_spectrum_update(struct vc_gdm70x_spectrum* spec_p,
+			  const struct vc_gdm70x_record* rec_p)
+{
+  struct vc_gdm70x_spectrum_channel* ch_p;
+  double x, t, span;
+  int c, size;
+
+  assert(spec_p);
+  assert(rec_p);
+
+  size = spec_p->size;
+
+  if(spec_p->count == 0)
+    spec_p->t0 = rec_p->ts;
+
+  for(c = 0; c < 2; c++) {
+    ch_p = spec_p->ch + c;
+
+    x = vc_gdm70x_data_si(c ? &(rec_p->data2) : &(rec_p->data1));
+    if(x != x)
+      x = ch_p->last;
+    ch_p->last = x;
+
+    /* the cosine of bin k is cos_n[k], so bins start at index 1 */
+    spectrum_slide(ch_p->re, ch_p->im, spec_p->cos_n + 1, spec_p->sin_n + 1,
+		   x - ch_p->sample[spec_p->pos], spec_p->stride);
+    ch_p->sample[spec_p->pos] = x;
+  }
+
+  t = (rec_p->ts.tv_sec - spec_p->t0.tv_sec) +
+      (rec_p->ts.tv_nsec - spec_p->t0.tv_nsec) * 1e-9;
+  spec_p->time[spec_p->pos] = t;
+
+  spec_p->pos = (spec_p->pos + 1) % size;
+  spec_p->count++;
+
+  if(spec_p->count % ((unsigned long) size * VC_GDM70X_SPECTRUM_SYNC) == 0) {
+    spectrum_sync(spec_p, spec_p->ch);
+    spectrum_sync(spec_p, spec_p->ch + 1);
+  }
+
+  if(spec_p->count < (unsigned long) size)
+    return 0;
+
+  /* the oldest sample is at pos now */
+  span = t - spec_p->time[spec_p->pos];
+  spec_p->rate = (span > 0) ? (size - 1) / span : 0;
+
+  if( ((spec_p->count - size) % spec_p->interval) != 0 || !spec_p->func_report)
+    return 0;
+
+  vc_gdm70x_spectrum_peak(spec_p, 1);
+  vc_gdm70x_spectrum_peak(spec_p, 2);
+
+  return spec_p->func_report(spec_p, rec_p, spec_p->func_report_ext);
+}
+
+int
+vc_gdm70x_spectrum_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  return vc_gdm70x_spectrum_update((struct vc_gdm70x_spectrum*) ptr, &rec);
+}
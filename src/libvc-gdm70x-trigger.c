@@ -0,0 +1,338 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-trigger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+struct vc_gdm70x_trigger*
+vc_gdm70x_trigger_create(int pre, int post)
+{
+  struct vc_gdm70x_trigger* trig_p;
+
+  assert(pre >= 0);
+  assert(post >= 0);
+
+  trig_p = malloc(sizeof(struct vc_gdm70x_trigger));
+  if(!trig_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_trigger_create: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(trig_p,0,sizeof(struct vc_gdm70x_trigger));
+  trig_p->channel = 1;
+  trig_p->pre = pre;
+  trig_p->post = post;
+
+  if(pre > 0) {
+    trig_p->ring = malloc(pre * sizeof(struct vc_gdm70x_record));
+    if(!trig_p->ring) {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_trigger_create: malloc failed.\n",stderr);
+      free(trig_p);
+      return 0;
+    }
+  }
+
+  return trig_p;
+}
+
+void
+vc_gdm70x_trigger_destroy(struct vc_gdm70x_trigger* trig_p)
+{
+  if(!trig_p)
+    return;
+
+  free(trig_p->ring);
+  free(trig_p);
+}
+
+int
+vc_gdm70x_trigger_setcondition(struct vc_gdm70x_trigger* trig_p, int channel,
+			       int type, double level, double high)
+{
+  assert(trig_p);
+
+  if((channel != 1 && channel != 2) ||
+     type < VC_GDM70X_TRIGGER_BELOW || type > VC_GDM70X_TRIGGER_OUTSIDE) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_trigger_setcondition: invalid condition.\n",stderr);
+    return -1;
+  }
+
+  trig_p->channel = channel;
+  trig_p->type = type;
+  trig_p->level = level;
+  trig_p->high = high;
+  trig_p->last_valid = 0;
+
+  return 0;
+}
+
+/* parse_level: parse a number with an optional multiplier */
+static const char*
+parse_level(const char* str, double* level)
+{
+  char* end;
+
+  *level = strtod(str, &end);
+  if(end == str)
+    return 0;
+
+  switch(*end) {
+  case 'n': *level *= 1e-9; end++; break;
+  case 'u': *level *= 1e-6; end++; break;
+  case 'm': *level *= 1e-3; end++; break;
+  case 'k': *level *= 1e3;  end++; break;
+  case 'M': *level *= 1e6;  end++; break;
+  }
+
+  return end;
+}
+
+int
+vc_gdm70x_trigger_parse(struct vc_gdm70x_trigger* trig_p, const char* spec)
+{
+  static const char ops[] = "<>/\\=!";
+  const char* op;
+  const char* p;
+  double level, high = 0;
+  int type;
+
+  assert(trig_p);
+  assert(spec);
+
+  if(spec[0] != 'D' || (spec[1] != '1' && spec[1] != '2') || spec[2] == 0 ||
+     !(op = strchr(ops, spec[2])))
+    goto invalid;
+
+  type = op - ops;
+
+  p = parse_level(spec + 3, &level);
+  if(!p)
+    goto invalid;
+
+  if(type == VC_GDM70X_TRIGGER_INSIDE || type == VC_GDM70X_TRIGGER_OUTSIDE) {
+    if(*p != ':' || !(p = parse_level(p + 1, &high)) || high < level)
+      goto invalid;
+  }
+
+  if(*p != 0)
+    goto invalid;
+
+  return vc_gdm70x_trigger_setcondition(trig_p, spec[1] - '0', type, level, high);
+
+invalid:
+  if(vc_gdm70x_verbose)
+    fprintf(stderr,"vc_gdm70x_trigger_parse: invalid condition '%s'.\n",spec);
+  return -1;
+}
+
+void
+vc_gdm70x_trigger_setfunc_record(struct vc_gdm70x_trigger* trig_p,
+				 int (*func) (const struct vc_gdm70x_record* rec_p,
+					      void* ptr),
+				 void* ptr)
+{
+  assert(trig_p);
+
+  trig_p->func_record = func;
+  trig_p->func_record_ext = ptr;
+}
+
+void
+vc_gdm70x_trigger_setfunc_fire(struct vc_gdm70x_trigger* trig_p,
+			       int (*func) (struct vc_gdm70x_trigger* trig_p,
+					    const struct vc_gdm70x_record* rec_p,
+					    void* ptr),
+			       void* ptr)
+{
+  assert(trig_p);
+
+  trig_p->func_fire = func;
+  trig_p->func_fire_ext = ptr;
+}
+
+static int
+trigger_sink(const struct vc_gdm70x_record* rec_p, void* ptr)
+{
+  struct vc_gdm70x_sink* sink_p;
+  int retval = 0;
+
+  for(sink_p = ptr; sink_p; sink_p = sink_p->next)
+    if(vc_gdm70x_sink_write(sink_p, rec_p))
+      retval = -1;
+
+  return retval;
+}
+
+void
+vc_gdm70x_trigger_setsink(struct vc_gdm70x_trigger* trig_p,
+			  struct vc_gdm70x_sink* sink_p)
+{
+  vc_gdm70x_trigger_setfunc_record(trig_p, trigger_sink, sink_p);
+}
+
+/* trigger_condition: evaluate the condition, NAN never fires */
+static int
+trigger_condition(struct vc_gdm70x_trigger* trig_p, double value)
+{
+  int last_valid = trig_p->last_valid;
+  double last = trig_p->last;
+
+  trig_p->last_valid = !isnan(value);
+  trig_p->last = value;
+
+  if(isnan(value))
+    return 0;
+
+  switch(trig_p->type) {
+  case VC_GDM70X_TRIGGER_BELOW:
+    return value < trig_p->level;
+  case VC_GDM70X_TRIGGER_ABOVE:
+    return value > trig_p->level;
+  case VC_GDM70X_TRIGGER_RISING:
+    return last_valid && last < trig_p->level && value >= trig_p->level;
+  case VC_GDM70X_TRIGGER_FALLING:
+    return last_valid && last > trig_p->level && value <= trig_p->level;
+  case VC_GDM70X_TRIGGER_INSIDE:
+    return value >= trig_p->level && value <= trig_p->high;
+  case VC_GDM70X_TRIGGER_OUTSIDE:
+    return value < trig_p->level || value > trig_p->high;
+  }
+
+  return 0;
+}
+
+static int
+trigger_pass(struct vc_gdm70x_trigger* trig_p, const struct vc_gdm70x_record* rec_p)
+{
+  if(trig_p->func_record)
+    return trig_p->func_record(rec_p, trig_p->func_record_ext);
+
+  return 0;
+}
+
+int
+vc_gdm70x_trigger_record(struct vc_gdm70x_trigger* trig_p,
+			 const struct vc_gdm70x_record* rec_p)
+{
+  int fire, retval = 0;
+
+  assert(trig_p);
+  assert(rec_p);
+
+  fire = trigger_condition(trig_p, vc_gdm70x_data_si(trig_p->channel == 1 ?
+						     &(rec_p->data1) :
+						     &(rec_p->data2)));
+
+  if(trig_p->capturing) {
+    if(fire) {
+      trig_p->remaining = trig_p->post;
+      return trigger_pass(trig_p, rec_p);
+    }
+
+    if(trig_p->remaining > 0) {
+      trig_p->remaining--;
+      return trigger_pass(trig_p, rec_p);
+    }
+
+    trig_p->capturing = 0;
+  }
+
+  if(fire) {
+    trig_p->triggers++;
+    trig_p->capturing = 1;
+    trig_p->remaining = trig_p->post;
+
+    if(trig_p->func_fire &&
+       trig_p->func_fire(trig_p, rec_p, trig_p->func_fire_ext))
+      retval = -1;
+
+    for(; trig_p->count > 0; trig_p->count--) {
+      if(trigger_pass(trig_p, trig_p->ring + trig_p->head))
+	retval = -1;
+      trig_p->head = (trig_p->head + 1) % trig_p->pre;
+    }
+
+    if(trigger_pass(trig_p, rec_p))
+      retval = -1;
+
+    return retval;
+  }
+
+  /* keep the record in the ring, dropping the oldest one */
+  if(trig_p->pre > 0) {
+    if(trig_p->count < trig_p->pre) {
+      trig_p->ring[(trig_p->head + trig_p->count) % trig_p->pre] = *rec_p;
+      trig_p->count++;
+    } else {
+      trig_p->ring[trig_p->head] = *rec_p;
+      trig_p->head = (trig_p->head + 1) % trig_p->pre;
+    }
+  }
+
+  return 0;
+}
+
+void
+vc_gdm70x_trigger_image(struct vc_gdm70x_trigger* trig_p,
+			const struct timespec* ts, const unsigned char* image)
+{
+  assert(trig_p);
+  assert(ts);
+  assert(image);
+
+  memcpy(trig_p->image, image, VC_GDM70X_IMAGE_SIZE);
+  trig_p->image_ts = *ts;
+  trig_p->image_valid = 1;
+}
+
+int
+vc_gdm70x_trigger_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  return vc_gdm70x_trigger_record((struct vc_gdm70x_trigger*) ptr, &rec);
+}
+
+int
+vc_gdm70x_trigger_image_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  assert(gdm_p);
+  assert(ptr);
+
+  if(gdm_p->image)
+    vc_gdm70x_trigger_image((struct vc_gdm70x_trigger*) ptr, &(gdm_p->ts),
+			    gdm_p->image);
+
+  return 0;
+}
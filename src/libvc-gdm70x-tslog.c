@@ -0,0 +1,768 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "vc-gdm70x-tslog.h"
+#include "libvc-gdm70x-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static const char block_magic[4] = "GDMB";
+
+static long long
+tslog_ns(const struct timespec* ts)
+{
+  return (long long) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void
+tslog_reset(struct vc_gdm70x_tslog* log_p)
+{
+  log_p->count = 0;
+  log_p->delta = 0;
+  log_p->runs = 0;
+  log_p->bits_len = 0;
+  log_p->acc = 0;
+  log_p->acc_bits = 0;
+  log_p->pos = 0;
+  log_p->index = 0;
+  memset(log_p->ch, 0, sizeof(log_p->ch));
+  log_p->ch[0].lead = log_p->ch[1].lead = -1;
+}
+
+/* bit stream, most significant bit first */
+
+static int
+put_bits(struct vc_gdm70x_tslog* log_p, unsigned long long v, int n)
+{
+  unsigned char* p;
+  size_t alloc;
+
+  if(n > 32) {
+    if(put_bits(log_p, v >> 32, n - 32))
+      return -1;
+    n = 32;
+  }
+
+  log_p->acc = (log_p->acc << n) | (v & (0xffffffffULL >> (32 - n)));
+  log_p->acc_bits += n;
+
+  while(log_p->acc_bits >= 8) {
+    if(log_p->bits_len == log_p->bits_alloc) {
+      alloc = log_p->bits_alloc ? 2 * log_p->bits_alloc : 4096;
+      p = realloc(log_p->bits, alloc);
+      if(!p) {
+	if(vc_gdm70x_verbose)
+	  fputs("vc_gdm70x_tslog_write: realloc failed.\n",stderr);
+	return -1;
+      }
+      log_p->bits = p;
+      log_p->bits_alloc = alloc;
+    }
+
+    log_p->acc_bits -= 8;
+    log_p->bits[log_p->bits_len++] = log_p->acc >> log_p->acc_bits;
+  }
+
+  return 0;
+}
+
+static int
+get_bits(struct vc_gdm70x_tslog* log_p, int n, unsigned long long* v)
+{
+  unsigned long long hi;
+  size_t byte;
+  int avail, take;
+
+  if(n > 32) {
+    if(get_bits(log_p, n - 32, &hi) || get_bits(log_p, 32, v))
+      return -1;
+    *v |= hi << 32;
+    return 0;
+  }
+
+  *v = 0;
+
+  while(n > 0) {
+    byte = log_p->pos >> 3;
+    if(byte >= log_p->bits_len)
+      return -1;
+
+    avail = 8 - (log_p->pos & 7);
+    take = (n < avail) ? n : avail;
+
+    *v = (*v << take) | ((log_p->bits[byte] >> (avail - take)) & ((1U << take) - 1));
+    log_p->pos += take;
+    n -= take;
+  }
+
+  return 0;
+}
+
+/* timestamps: delta of delta in buckets of 0, 16, 24, 32 and 64 bits */
+
+static const int dod_bits[]   = { 16, 24, 32, 64 };
+static const int dod_prefix[] = { 0x2, 0x6, 0xe, 0xf }; /* 10, 110, 1110, 1111 */
+static const int dod_plen[]   = { 2, 3, 4, 4 };
+
+static int
+put_dod(struct vc_gdm70x_tslog* log_p, long long dod)
+{
+  int i;
+
+  if(dod == 0)
+    return put_bits(log_p, 0, 1);
+
+  for(i = 0; i < 3; i++)
+    if(dod >= -(1LL << (dod_bits[i] - 1)) && dod < (1LL << (dod_bits[i] - 1)))
+      break;
+
+  if(put_bits(log_p, dod_prefix[i], dod_plen[i]))
+    return -1;
+
+  return put_bits(log_p, (unsigned long long) dod, dod_bits[i]);
+}
+
+static int
+get_dod(struct vc_gdm70x_tslog* log_p, long long* dod)
+{
+  unsigned long long v;
+  int i, n;
+
+  for(i = 0; i < 4; i++) {
+    if(get_bits(log_p, 1, &v))
+      return -1;
+    if(v == 0)
+      break;
+  }
+
+  if(i == 0) {
+    *dod = 0;
+    return 0;
+  }
+
+  n = dod_bits[i - 1];
+  if(get_bits(log_p, n, &v))
+    return -1;
+
+  /* sign extend */
+  *dod = (n < 64) ? (long long) (v << (64 - n)) >> (64 - n) : (long long) v;
+
+  return 0;
+}
+
+/* values: xor with the last value of the channel */
+
+static int
+put_value(struct vc_gdm70x_tslog* log_p, struct vc_gdm70x_tslog_channel* ch_p,
+	  float value)
+{
+  unsigned int v, x;
+  int lead, trail, len;
+
+  memcpy(&v, &value, 4);
+  x = v ^ ch_p->value;
+  ch_p->value = v;
+
+  if(x == 0)
+    return put_bits(log_p, 0, 1);
+
+  lead  = __builtin_clz(x);
+  trail = __builtin_ctz(x);
+
+  /* the meaningful bits fit into the window of the last xor */
+  if(ch_p->lead >= 0 && lead >= ch_p->lead && trail >= ch_p->trail) {
+    len = 32 - ch_p->lead - ch_p->trail;
+    return put_bits(log_p, 2, 2) ||
+           put_bits(log_p, x >> ch_p->trail, len);
+  }
+
+  len = 32 - lead - trail;
+  ch_p->lead = lead;
+  ch_p->trail = trail;
+
+  return put_bits(log_p, 3, 2) || put_bits(log_p, lead, 5) ||
+         put_bits(log_p, len - 1, 5) || put_bits(log_p, x >> trail, len);
+}
+
+static int
+get_value(struct vc_gdm70x_tslog* log_p, struct vc_gdm70x_tslog_channel* ch_p,
+	  float* value)
+{
+  unsigned long long v, lead, len;
+
+  if(get_bits(log_p, 1, &v))
+    return -1;
+
+  if(v) {
+    if(get_bits(log_p, 1, &v))
+      return -1;
+
+    if(v) {
+      if(get_bits(log_p, 5, &lead) || get_bits(log_p, 5, &len))
+	return -1;
+      ch_p->lead = lead;
+      ch_p->trail = 32 - lead - (len + 1);
+      if(ch_p->trail < 0)
+	return -1;
+    } else if(ch_p->lead < 0)
+      return -1;
+
+    if(get_bits(log_p, 32 - ch_p->lead - ch_p->trail, &v))
+      return -1;
+
+    ch_p->value ^= (unsigned int) v << ch_p->trail;
+  }
+
+  memcpy(value, &(ch_p->value), 4);
+
+  return 0;
+}
+
+struct vc_gdm70x_tslog*
+vc_gdm70x_tslog_open(const char* filename, int mode)
+{
+  struct vc_gdm70x_tslog* log_p;
+  unsigned char header[VC_GDM70X_TSLOG_BLOCK];
+  unsigned long long offset;
+  struct stat st;
+
+  assert(filename);
+
+  if( (mode != VC_GDM70X_TSLOG_READ) && (mode != VC_GDM70X_TSLOG_APPEND)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_open: invalid mode.\n",stderr);
+    return 0;
+  }
+
+  log_p = malloc(sizeof(struct vc_gdm70x_tslog));
+  if(!log_p) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_open: malloc failed.\n",stderr);
+    return 0;
+  }
+
+  memset(log_p, 0, sizeof(struct vc_gdm70x_tslog));
+  log_p->mode = mode;
+  log_p->block_records = VC_GDM70X_TSLOG_RECORDS;
+  log_p->flush_interval = -1;
+  tslog_reset(log_p);
+
+  if(mode == VC_GDM70X_TSLOG_APPEND)
+    log_p->fd = open(filename, O_RDWR | O_CREAT, 0666);
+  else
+    log_p->fd = open(filename, O_RDONLY);
+
+  if(log_p->fd < 0) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_tslog_open: open failed");
+    free(log_p);
+    return 0;
+  }
+
+  if(fstat(log_p->fd, &st))
+    goto fail;
+
+  if(st.st_size == 0 && mode == VC_GDM70X_TSLOG_APPEND) {
+    memset(header, 0, VC_GDM70X_TSLOG_HEADER);
+    memcpy(header, VC_GDM70X_TSLOG_MAGIC, 8);
+    vc_gdm70x_put32(header + 8, 1);
+    if(write(log_p->fd, header, VC_GDM70X_TSLOG_HEADER) != VC_GDM70X_TSLOG_HEADER)
+      goto fail;
+    log_p->offset = VC_GDM70X_TSLOG_HEADER;
+    return log_p;
+  }
+
+  if(pread(log_p->fd, header, VC_GDM70X_TSLOG_HEADER, 0) != VC_GDM70X_TSLOG_HEADER ||
+     memcmp(header, VC_GDM70X_TSLOG_MAGIC, 8) || vc_gdm70x_get32(header + 8) != 1) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_open: not a tslog.\n",stderr);
+    goto fail;
+  }
+
+  log_p->offset = VC_GDM70X_TSLOG_HEADER;
+
+  if(mode == VC_GDM70X_TSLOG_READ)
+    return log_p;
+
+  /* find the end of the last complete block */
+  for(offset = VC_GDM70X_TSLOG_HEADER;
+      pread(log_p->fd, header, VC_GDM70X_TSLOG_BLOCK, offset) == VC_GDM70X_TSLOG_BLOCK &&
+	!memcmp(header, block_magic, 4) &&
+	offset + VC_GDM70X_TSLOG_BLOCK + vc_gdm70x_get32(header + 8) <= (unsigned long long) st.st_size;
+      offset += VC_GDM70X_TSLOG_BLOCK + vc_gdm70x_get32(header + 8));
+
+  if(offset < (unsigned long long) st.st_size) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_open: removing incomplete block.\n",stderr);
+    if(ftruncate(log_p->fd, offset))
+      goto fail;
+  }
+
+  if(lseek(log_p->fd, offset, SEEK_SET) < 0)
+    goto fail;
+
+  log_p->offset = offset;
+
+  return log_p;
+
+fail:
+  if(vc_gdm70x_verbose && errno)
+    perror("vc_gdm70x_tslog_open: failed");
+  close(log_p->fd);
+  free(log_p);
+  return 0;
+}
+
+int
+vc_gdm70x_tslog_close(struct vc_gdm70x_tslog* log_p)
+{
+  int retval = 0;
+
+  if(!log_p)
+    return 0;
+
+  if(log_p->mode == VC_GDM70X_TSLOG_APPEND)
+    retval = vc_gdm70x_tslog_flush(log_p);
+
+  if(close(log_p->fd)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_tslog_close: close failed");
+    retval = -1;
+  }
+
+  free(log_p->run);
+  free(log_p->bits);
+  free(log_p);
+
+  return retval;
+}
+
+void
+vc_gdm70x_tslog_setblock(struct vc_gdm70x_tslog* log_p, int count)
+{
+  assert(log_p);
+  assert(count > 0);
+
+  log_p->block_records = count;
+}
+
+void
+vc_gdm70x_tslog_setflush(struct vc_gdm70x_tslog* log_p, int interval)
+{
+  assert(log_p);
+
+  log_p->flush_interval = interval;
+}
+
+/* tslog_expired: whether the current block is older than the flush
+   interval */
+static int
+tslog_expired(const struct vc_gdm70x_tslog* log_p)
+{
+  struct timespec now;
+  long ms;
+
+  if(log_p->flush_interval < 0 || log_p->count == 0)
+    return 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ms = (now.tv_sec - log_p->started.tv_sec) * 1000 +
+       (now.tv_nsec - log_p->started.tv_nsec) / 1000000;
+
+  return ms >= log_p->flush_interval;
+}
+
+int
+vc_gdm70x_tslog_write(struct vc_gdm70x_tslog* log_p,
+		      const struct vc_gdm70x_record* rec_p)
+{
+  struct vc_gdm70x_tslog_run* run_p;
+  long long t, delta;
+  unsigned long alloc;
+
+  assert(log_p);
+  assert(log_p->mode == VC_GDM70X_TSLOG_APPEND);
+  assert(rec_p);
+
+  t = tslog_ns(&(rec_p->ts));
+
+  if(log_p->count == 0) {
+    tslog_reset(log_p);
+    log_p->first = t;
+    if(log_p->flush_interval >= 0)
+      clock_gettime(CLOCK_MONOTONIC, &(log_p->started));
+  } else {
+    delta = t - log_p->last;
+    if(put_dod(log_p, delta - log_p->delta))
+      return -1;
+    log_p->delta = delta;
+  }
+
+  if(put_value(log_p, log_p->ch, rec_p->data1.value) ||
+     put_value(log_p, log_p->ch + 1, rec_p->data2.value))
+    return -1;
+
+  run_p = log_p->runs ? log_p->run + log_p->runs - 1 : 0;
+
+  if(!run_p || run_p->unit1 != rec_p->data1.unit || run_p->mult1 != rec_p->data1.mult ||
+     run_p->unit2 != rec_p->data2.unit || run_p->mult2 != rec_p->data2.mult) {
+    if(log_p->runs == log_p->runs_alloc) {
+      alloc = log_p->runs_alloc ? 2 * log_p->runs_alloc : 16;
+      run_p = realloc(log_p->run, alloc * sizeof(struct vc_gdm70x_tslog_run));
+      if(!run_p) {
+	if(vc_gdm70x_verbose)
+	  fputs("vc_gdm70x_tslog_write: realloc failed.\n",stderr);
+	return -1;
+      }
+      log_p->run = run_p;
+      log_p->runs_alloc = alloc;
+    }
+
+    run_p = log_p->run + log_p->runs++;
+    run_p->count = 0;
+    run_p->unit1 = rec_p->data1.unit;
+    run_p->mult1 = rec_p->data1.mult;
+    run_p->unit2 = rec_p->data2.unit;
+    run_p->mult2 = rec_p->data2.mult;
+  }
+
+  run_p->count++;
+  log_p->last = t;
+  log_p->count++;
+
+  if(log_p->count >= (unsigned long) log_p->block_records || tslog_expired(log_p))
+    return vc_gdm70x_tslog_flush(log_p);
+
+  return 0;
+}
+
+int
+vc_gdm70x_tslog_flush(struct vc_gdm70x_tslog* log_p)
+{
+  unsigned char header[VC_GDM70X_TSLOG_BLOCK];
+  unsigned char* runs;
+  struct iovec iov[3];
+  size_t size;
+  unsigned long i;
+  ssize_t n;
+
+  assert(log_p);
+
+  if(log_p->count == 0)
+    return 0;
+
+  /* pad the bit stream to full bytes */
+  if(log_p->acc_bits && put_bits(log_p, 0, 8 - log_p->acc_bits))
+    return -1;
+
+  runs = malloc(log_p->runs * VC_GDM70X_TSLOG_RUN);
+  if(!runs) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_flush: malloc failed.\n",stderr);
+    return -1;
+  }
+
+  for(i = 0; i < log_p->runs; i++) {
+    vc_gdm70x_put32(runs + i * VC_GDM70X_TSLOG_RUN, log_p->run[i].count);
+    runs[i * VC_GDM70X_TSLOG_RUN + 4] = log_p->run[i].unit1;
+    runs[i * VC_GDM70X_TSLOG_RUN + 5] = log_p->run[i].mult1;
+    runs[i * VC_GDM70X_TSLOG_RUN + 6] = log_p->run[i].unit2;
+    runs[i * VC_GDM70X_TSLOG_RUN + 7] = log_p->run[i].mult2;
+  }
+
+  size = log_p->runs * VC_GDM70X_TSLOG_RUN + log_p->bits_len;
+
+  memcpy(header, block_magic, 4);
+  vc_gdm70x_put32(header + 4, log_p->count);
+  vc_gdm70x_put32(header + 8, size);
+  vc_gdm70x_put32(header + 12, log_p->runs);
+  vc_gdm70x_put64(header + 16, log_p->first);
+  vc_gdm70x_put64(header + 24, log_p->last);
+
+  iov[0].iov_base = header;
+  iov[0].iov_len  = VC_GDM70X_TSLOG_BLOCK;
+  iov[1].iov_base = runs;
+  iov[1].iov_len  = log_p->runs * VC_GDM70X_TSLOG_RUN;
+  iov[2].iov_base = log_p->bits;
+  iov[2].iov_len  = log_p->bits_len;
+
+  n = writev(log_p->fd, iov, 3);
+  free(runs);
+
+  tslog_reset(log_p);
+
+  if(n != (ssize_t) (VC_GDM70X_TSLOG_BLOCK + size)) {
+    if(vc_gdm70x_verbose)
+      perror("vc_gdm70x_tslog_flush: writev failed");
+
+    /* cut off a partial block, readers stop at a corrupt one */
+    if(ftruncate(log_p->fd, log_p->offset) || (lseek(log_p->fd, log_p->offset, SEEK_SET) < 0))
+      if(vc_gdm70x_verbose)
+	perror("vc_gdm70x_tslog_flush: truncate failed");
+    return -1;
+  }
+
+  log_p->offset += n;
+
+  return 0;
+}
+
+int
+vc_gdm70x_tslog_flush_due(struct vc_gdm70x_tslog* log_p)
+{
+  assert(log_p);
+
+  return tslog_expired(log_p) ? vc_gdm70x_tslog_flush(log_p) : 0;
+}
+
+/* tslog_load: read the block at log_p->offset, returns 0 at the end */
+static int
+tslog_load(struct vc_gdm70x_tslog* log_p)
+{
+  unsigned char header[VC_GDM70X_TSLOG_BLOCK];
+  unsigned char* p;
+  size_t size;
+  unsigned long i, runs, total = 0;
+  ssize_t n;
+
+  /* a block still being written counts as end of the log */
+  n = pread(log_p->fd, header, VC_GDM70X_TSLOG_BLOCK, log_p->offset);
+  if(n >= 0 && n < VC_GDM70X_TSLOG_BLOCK)
+    return 0;
+
+  if(n != VC_GDM70X_TSLOG_BLOCK || memcmp(header, block_magic, 4))
+    goto corrupt;
+
+  tslog_reset(log_p);
+
+  size = vc_gdm70x_get32(header + 8);
+  runs = vc_gdm70x_get32(header + 12);
+
+  if(size > log_p->bits_alloc) {
+    p = realloc(log_p->bits, size);
+    if(!p)
+      goto corrupt;
+    log_p->bits = p;
+    log_p->bits_alloc = size;
+  }
+
+  if(runs > log_p->runs_alloc) {
+    p = realloc(log_p->run, runs * sizeof(struct vc_gdm70x_tslog_run));
+    if(!p)
+      goto corrupt;
+    log_p->run = (struct vc_gdm70x_tslog_run*) p;
+    log_p->runs_alloc = runs;
+  }
+
+  if(runs * VC_GDM70X_TSLOG_RUN > size)
+    goto corrupt;
+
+  n = pread(log_p->fd, log_p->bits, size, log_p->offset + VC_GDM70X_TSLOG_BLOCK);
+  if(n >= 0 && n < (ssize_t) size)
+    return 0;
+  if(n < 0)
+    goto corrupt;
+
+  for(i = 0; i < runs; i++) {
+    p = log_p->bits + i * VC_GDM70X_TSLOG_RUN;
+    log_p->run[i].count = vc_gdm70x_get32(p);
+    log_p->run[i].unit1 = p[4];
+    log_p->run[i].mult1 = p[5];
+    log_p->run[i].unit2 = p[6];
+    log_p->run[i].mult2 = p[7];
+    total += log_p->run[i].count;
+  }
+
+  log_p->count = vc_gdm70x_get32(header + 4);
+  if(total != log_p->count || runs == 0)
+    goto corrupt;
+
+  log_p->runs = runs;
+  log_p->first = vc_gdm70x_get64(header + 16);
+  log_p->bits_len = size;
+  log_p->pos = runs * VC_GDM70X_TSLOG_RUN * 8;
+  log_p->run_index = 0;
+  log_p->run_left = log_p->run[0].count;
+  log_p->offset += VC_GDM70X_TSLOG_BLOCK + size;
+
+  return 1;
+
+corrupt:
+  if(vc_gdm70x_verbose)
+    fputs("vc_gdm70x_tslog_read: corrupt block.\n",stderr);
+  return -1;
+}
+
+/* tslog_decode: decode the next record of the current block */
+static int
+tslog_decode(struct vc_gdm70x_tslog* log_p, struct vc_gdm70x_record* rec_p)
+{
+  const struct vc_gdm70x_tslog_run* run_p;
+  long long dod, t;
+
+  if(log_p->index == 0)
+    t = log_p->first;
+  else {
+    if(get_dod(log_p, &dod))
+      return -1;
+    log_p->delta += dod;
+    t = log_p->last + log_p->delta;
+  }
+
+  if(get_value(log_p, log_p->ch, &(rec_p->data1.value)) ||
+     get_value(log_p, log_p->ch + 1, &(rec_p->data2.value)))
+    return -1;
+
+  while(log_p->run_left == 0) {
+    if(++log_p->run_index >= log_p->runs)
+      return -1;
+    log_p->run_left = log_p->run[log_p->run_index].count;
+  }
+
+  run_p = log_p->run + log_p->run_index;
+  log_p->run_left--;
+
+  rec_p->data1.unit = run_p->unit1;
+  rec_p->data1.mult = run_p->mult1;
+  rec_p->data2.unit = run_p->unit2;
+  rec_p->data2.mult = run_p->mult2;
+
+  rec_p->ts.tv_sec  = t / 1000000000LL;
+  rec_p->ts.tv_nsec = t % 1000000000LL;
+  if(rec_p->ts.tv_nsec < 0) {
+    rec_p->ts.tv_nsec += 1000000000L;
+    rec_p->ts.tv_sec--;
+  }
+
+  log_p->last = t;
+  log_p->index++;
+
+  return 0;
+}
+
+int
+vc_gdm70x_tslog_read(struct vc_gdm70x_tslog* log_p, struct vc_gdm70x_record* rec_p)
+{
+  int n;
+
+  assert(log_p);
+  assert(log_p->mode == VC_GDM70X_TSLOG_READ);
+  assert(rec_p);
+
+  if(log_p->pending_valid) {
+    *rec_p = log_p->pending;
+    log_p->pending_valid = 0;
+    return 1;
+  }
+
+  while(log_p->index >= log_p->count)
+    if( (n = tslog_load(log_p)) <= 0)
+      return n;
+
+  if(tslog_decode(log_p, rec_p)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_tslog_read: corrupt block.\n",stderr);
+    return -1;
+  }
+
+  return 1;
+}
+
+int
+vc_gdm70x_tslog_seek(struct vc_gdm70x_tslog* log_p, const struct timespec* ts)
+{
+  unsigned char header[VC_GDM70X_TSLOG_BLOCK];
+  long long t;
+  int n;
+
+  assert(log_p);
+  assert(log_p->mode == VC_GDM70X_TSLOG_READ);
+  assert(ts);
+
+  t = tslog_ns(ts);
+
+  log_p->pending_valid = 0;
+  log_p->count = log_p->index = 0;
+  log_p->offset = VC_GDM70X_TSLOG_HEADER;
+
+  /* skip the blocks ending before ts */
+  while(pread(log_p->fd, header, VC_GDM70X_TSLOG_BLOCK, log_p->offset) == VC_GDM70X_TSLOG_BLOCK &&
+	!memcmp(header, block_magic, 4) && (long long) vc_gdm70x_get64(header + 24) < t)
+    log_p->offset += VC_GDM70X_TSLOG_BLOCK + vc_gdm70x_get32(header + 8);
+
+  while( (n = vc_gdm70x_tslog_read(log_p, &(log_p->pending))) > 0)
+    if(tslog_ns(&(log_p->pending.ts)) >= t) {
+      log_p->pending_valid = 1;
+      break;
+    }
+
+  return (n < 0) ? -1 : 0;
+}
+
+long long
+vc_gdm70x_tslog_count(struct vc_gdm70x_tslog* log_p)
+{
+  unsigned char header[VC_GDM70X_TSLOG_BLOCK];
+  unsigned long long offset = VC_GDM70X_TSLOG_HEADER;
+  long long count = 0;
+  struct stat st;
+
+  assert(log_p);
+
+  if(fstat(log_p->fd, &st))
+    return -1;
+
+  /* complete blocks only */
+  while(pread(log_p->fd, header, VC_GDM70X_TSLOG_BLOCK, offset) == VC_GDM70X_TSLOG_BLOCK &&
+	!memcmp(header, block_magic, 4) &&
+	offset + VC_GDM70X_TSLOG_BLOCK + vc_gdm70x_get32(header + 8) <= (unsigned long long) st.st_size) {
+    count += vc_gdm70x_get32(header + 4);
+    offset += VC_GDM70X_TSLOG_BLOCK + vc_gdm70x_get32(header + 8);
+  }
+
+  /* records not yet written */
+  if(log_p->mode == VC_GDM70X_TSLOG_APPEND)
+    count += log_p->count;
+
+  return count;
+}
+
+int
+vc_gdm70x_tslog_func(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct vc_gdm70x_record rec;
+
+  assert(gdm_p);
+  assert(ptr);
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  return vc_gdm70x_tslog_write((struct vc_gdm70x_tslog*) ptr, &rec);
+}
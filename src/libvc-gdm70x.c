@@ -20,17 +20,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "../config.h"
 #include "vc-gdm70x.h"
+#include "vc-gdm70x-capture.h"
+#include "libvc-gdm70x-private.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <assert.h>
+#include <math.h>
 #include <langinfo.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+/* a read of the tty times out after VTIME */
+#define READ_TIMEOUT 1000
 
 /* vc_gdm70x_parsevalue: parse a record, only for internal usage */
 int vc_gdm70x_parsevalue(const char* str, struct vc_gdm70x_data* data_p);
@@ -53,9 +63,7 @@ vc_gdm70x_create()
     return 0;
   }
 
-  memset(ptr,0,sizeof(struct vc_gdm70x));
-
-  ptr->fd = -1;
+  vc_gdm70x_init(ptr);
 
   return ptr;
 }
@@ -65,13 +73,52 @@ vc_gdm70x_destroy(struct vc_gdm70x* gdm_p)
 {
   assert(gdm_p);
 
+  vc_gdm70x_fini(gdm_p);
+
+  free(gdm_p);
+}
+
+void 
+vc_gdm70x_init(struct vc_gdm70x* gdm_p) 
+{
+  assert(gdm_p);
+
+  memset(gdm_p,0,sizeof(struct vc_gdm70x));
+
+  gdm_p->fd = -1;
+}
+
+void 
+vc_gdm70x_fini(struct vc_gdm70x* gdm_p) 
+{
+  assert(gdm_p);
+
   if(gdm_p->fd > -1)
     vc_gdm70x_close(gdm_p);
 
   vc_gdm70x_setfunc_data(gdm_p,0,0);
   vc_gdm70x_setfunc_image(gdm_p,0,0);
+  vc_gdm70x_setimagebuffer(gdm_p,0);
+  vc_gdm70x_tap(gdm_p,0);
+}
 
-  free(gdm_p);
+void 
+vc_gdm70x_setimagebuffer(struct vc_gdm70x* gdm_p, unsigned char* image) 
+{
+  assert(gdm_p);
+
+  if(gdm_p->image && gdm_p->image_owned)
+    free(gdm_p->image);
+
+  gdm_p->image = image;
+  gdm_p->image_owned = 0;
+  gdm_p->image_fp_valid = 0;
+
+  /* the image callback would get no image */
+  if(!image) {
+    gdm_p->func_image = 0;
+    gdm_p->func_image_ext = 0;
+  }
 }
 
 int 
@@ -102,13 +149,48 @@ vc_gdm70x_setfunc_image( struct vc_gdm70x* gdm_p,
       gdm_p->func_image = 0;
       return -1;
     }
-  } else if(gdm_p->image && !func_image) {
+    gdm_p->image_owned = 1;
+  } else if(gdm_p->image && gdm_p->image_owned && !func_image) {
     free(gdm_p->image);
     gdm_p->image = 0;
+    gdm_p->image_owned = 0;
   }
 
   gdm_p->func_image = func_image;
   gdm_p->func_image_ext = image_ptr;
+  gdm_p->image_fp_valid = 0;
+
+  return 0;
+}
+
+int 
+vc_gdm70x_setfunc_idle( struct vc_gdm70x* gdm_p, 
+			int (* func_idle) (struct vc_gdm70x* gdm_p, void* ptr),
+			void* idle_ptr, int ms) 
+{
+  assert(gdm_p);
+  assert(!func_idle || ms > 0);
+
+  gdm_p->func_idle = func_idle;
+  gdm_p->func_idle_ext = idle_ptr;
+  gdm_p->idle_ms = ms;
+
+  return 0;
+}
+
+int 
+vc_gdm70x_setimagemode(struct vc_gdm70x* gdm_p, int mode) 
+{
+  assert(gdm_p);
+
+  if( (mode != VC_GDM70X_IMAGE_ALL) && (mode != VC_GDM70X_IMAGE_CHANGED)) {
+    if(vc_gdm70x_verbose)
+      fputs("vc_gdm70x_setimagemode: invalid mode.\n",stderr);
+    return -1;
+  }
+
+  gdm_p->image_mode = mode;
+  gdm_p->image_fp_valid = 0;
 
   return 0;
 }
@@ -147,7 +229,7 @@ vc_gdm70x_open( struct vc_gdm70x* gdm_p, const char* device)
   newtio.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
 
   
-  newtio.c_cc[VTIME] = 10;
+  newtio.c_cc[VTIME] = READ_TIMEOUT / 100;
   newtio.c_cc[VMIN] = 0;
   
   cfsetispeed(&newtio,B9600);
@@ -177,6 +259,43 @@ vc_gdm70x_open( struct vc_gdm70x* gdm_p, const char* device)
   }
 
   gdm_p->sync = 0;
+  gdm_p->error = 0;
+
+  return 0;
+}
+
+int 
+vc_gdm70x_check(struct vc_gdm70x* gdm_p) 
+{
+  struct stat st;
+  unsigned int data;
+
+  assert(gdm_p);
+
+  if(gdm_p->fd < 0)
+    return -1;
+
+  /* a replay is gone once it is read completely */
+  if(gdm_p->replay)
+    return gdm_p->replay->eof ? -1 : 0;
+
+  switch(gdm_p->error) {
+  case EIO:
+  case ENXIO:
+  case ENODEV:
+  case EBADF:
+    return -1;
+  }
+
+  /* the device node vanishes when an usb adapter is unplugged */
+  if(fstat(gdm_p->fd,&st) || st.st_nlink == 0)
+    return -1;
+
+  if(ioctl(gdm_p->fd,TIOCMGET,&data) < 0)
+    if( (errno == EIO) || (errno == ENXIO) || (errno == ENODEV)) {
+      gdm_p->error = errno;
+      return -1;
+    }
 
   return 0;
 }
@@ -187,6 +306,13 @@ vc_gdm70x_close(struct vc_gdm70x* gdm_p)
   assert(gdm_p);
   assert(gdm_p->fd >= 0);
 
+  if(gdm_p->replay) {
+    vc_gdm70x_capture_close(gdm_p->replay);
+    gdm_p->replay = 0;
+    gdm_p->fd = -1;
+    return;
+  }
+
   if( tcsetattr(gdm_p->fd,TCSAFLUSH, &(gdm_p->oldtio)))
     if(vc_gdm70x_verbose)
       perror("vc_gdm70x_close: tcsetattr failed");
@@ -244,113 +370,174 @@ vc_gdm70x_sync(struct vc_gdm70x* gdm_p)
 }
 
 
-int 
-vc_gdm70x_do(struct vc_gdm70x* gdm_p, int skip) 
+/* vc_gdm70x_receive: receive one record or image, the gdm must be synced */
+static int
+vc_gdm70x_receive(struct vc_gdm70x* gdm_p) 
 {
   char buffer[26];
   signed int i,j,s,bytes;
+  int unchanged;
+  unsigned long long fp;
 
-  assert(gdm_p);
-  assert(gdm_p->fd >= 0);
+  memset(buffer,0,26);
+  i = 0;
+  bytes = 0;
+    
+  i += vc_gdm70x_read(gdm_p, buffer,2);
+    
+  if(gdm_p->replay)
+    vc_gdm70x_capture_time(gdm_p->replay,&(gdm_p->ts));
+  else
+    clock_gettime(CLOCK_REALTIME,&(gdm_p->ts));
 
-  if(gdm_p->sync == 0) {
-    if(vc_gdm70x_verbose > 2)
-      fputs("vc_gdm70x_do: gdm not synced, trying to sync.\n",stderr);
-    if(vc_gdm70x_sync(gdm_p)) {
+  if(i < 2) {  
+    if(vc_gdm70x_verbose > 1)
+      fputs("vc_gdm70x_do: read failed.\n",stderr);
+    return -1;
+  }
+
+  if( buffer[0] != 0x02 ) {
+    if(vc_gdm70x_verbose > 1)
+      fputs("vc_gdm70x_do: sync lost.\n",stderr);
+    gdm_p->sync = 0;
+    return -1;
+  }
+    
+  if ( buffer[1] == 'Z' ) {
+    if(gdm_p->image)
+      memset(gdm_p->image,0,1024);
+
+    j = 0;
+
+    for(; i < 1027; i += bytes ) {
+      if( (bytes = vc_gdm70x_read(gdm_p, buffer, ( 24 < i ) ? (24) : (i))) <= 0) {
+	if(vc_gdm70x_verbose > 1)
+	  fputs("vc_gdm70x_do: read failed.\n",stderr);
+	return -1;
+      }
+
+      if(gdm_p->image)
+	for(s = 0; (s < bytes * 8) && (j < 8*1024); s++,j++)
+	  gdm_p->image[( (i-2+s/8)%128 + ( ((i-2+s/8)/128)*8 + (s%8) )*128 )/8] |= ((buffer[s/8] & (0x01 << (s%8))) ? (0x80 >> ((i-2+s/8)%8)) : 0);
+    }
+      
+    if( (bytes <= 0) || (*(buffer+bytes-1) != 0x03) ) {
       if(vc_gdm70x_verbose > 1)
-	fputs("vc_gdm70x_do: vc_gdm70x_sync failed.\n",stderr);
+	fputs("vc_gdm70x_do: sync lost.\n",stderr);
+      gdm_p->sync = 0;
       return -1;
     }
-  }
 
-  do {
-    memset(buffer,0,26);
-    i = 0;
-    
-    i += vc_gdm70x_read(gdm_p, buffer,2);
-    
-    clock_gettime(CLOCK_REALTIME,&(gdm_p->ts));
+    /* there is no image to report without a buffer */
+    if(!gdm_p->image)
+      return VC_GDM70X_NONE;
+      
+    unchanged = 0;
+
+    if(gdm_p->image && gdm_p->image_mode == VC_GDM70X_IMAGE_CHANGED) {
+      fp = vc_gdm70x_image_fingerprint(gdm_p->image);
+      unchanged = gdm_p->image_fp_valid && (gdm_p->image_fp == fp);
+      gdm_p->image_fp = fp;
+      gdm_p->image_fp_valid = 1;
+    }
 
-    if(i < 2) {  
+    if(unchanged) {
+      if(vc_gdm70x_verbose > 2)
+	fputs("vc_gdm70x_do: picture unchanged.\n",stderr);
+      return VC_GDM70X_NONE;
+    }
+
+    return VC_GDM70X_IMAGE;
+  } 
+
+  do{
+    if( (bytes = vc_gdm70x_read(gdm_p,buffer + i, 26 - i)) <= 0) {
       if(vc_gdm70x_verbose > 1)
 	fputs("vc_gdm70x_do: read failed.\n",stderr);
       return -1;
     }
+    i+= bytes;
+  } while ( i < 26);
+
+  if( buffer[25] != 0x03) {
+    if(vc_gdm70x_verbose > 1)
+      fputs("vc_gdm70x_do: sync lost.\n",stderr);
+    gdm_p->sync = 0;
+    return -1;
+  }
 
-    if( buffer[0] != 0x02 ) {
+  if( vc_gdm70x_parsevalue(buffer+13,&(gdm_p->data2)))
+    return -1;
+  if( vc_gdm70x_parsevalue(buffer+1,&(gdm_p->data1)))
+    return -1;
+
+  return VC_GDM70X_DATA;
+}
+
+/* vc_gdm70x_dosync: sync with the gdm if needed */
+static int
+vc_gdm70x_dosync(struct vc_gdm70x* gdm_p) 
+{
+  if(gdm_p->sync == 0) {
+    if(vc_gdm70x_verbose > 2)
+      fputs("vc_gdm70x_do: gdm not synced, trying to sync.\n",stderr);
+    if(vc_gdm70x_sync(gdm_p)) {
       if(vc_gdm70x_verbose > 1)
-	fputs("vc_gdm70x_do: sync lost.\n",stderr);
-      gdm_p->sync = 0;
+	fputs("vc_gdm70x_do: vc_gdm70x_sync failed.\n",stderr);
       return -1;
     }
-    
-    if ( buffer[1] == 'Z' ) {
-      if(gdm_p->image)
-	memset(gdm_p->image,0,1024);
+  }
 
-      j = 0;
+  return 0;
+}
 
-      for(; i < 1027; i += bytes ) {
-	if( (bytes = vc_gdm70x_read(gdm_p, buffer, ( 24 < i ) ? (24) : (i))) <= 0) {
-	  if(vc_gdm70x_verbose > 1)
-	    fputs("vc_gdm70x_do: read failed.\n",stderr);
-	  return -1;
-	}
+int 
+vc_gdm70x_next(struct vc_gdm70x* gdm_p) 
+{
+  assert(gdm_p);
+  assert(gdm_p->fd >= 0);
 
-	if(gdm_p->image)
-	  for(s = 0; (s < bytes * 8) && (j < 8*1024); s++,j++)
-	    gdm_p->image[( (i-2+s/8)%128 + ( ((i-2+s/8)/128)*8 + (s%8) )*128 )/8] |= ((buffer[s/8] & (0x01 << (s%8))) ? (0x80 >> ((i-2+s/8)%8)) : 0);
-	  
-	
-      }
-	
-      
-      if( *(buffer+bytes-1) != 0x03) {
-	if(vc_gdm70x_verbose > 1)
-	  fputs("vc_gdm70x_do: sync lost.\n",stderr);
-	gdm_p->sync = 0;
-	return -1;
-      }
-      
+  if(vc_gdm70x_dosync(gdm_p))
+    return -1;
+
+  return vc_gdm70x_receive(gdm_p);
+}
+
+int 
+vc_gdm70x_do(struct vc_gdm70x* gdm_p, int skip) 
+{
+  signed int bytes;
+
+  assert(gdm_p);
+  assert(gdm_p->fd >= 0);
+
+  if(vc_gdm70x_dosync(gdm_p))
+    return -1;
+
+  do {
+    switch(vc_gdm70x_receive(gdm_p)) {
+    case VC_GDM70X_IMAGE:
       if(gdm_p->func_image) {
 	if( gdm_p->func_image(gdm_p,gdm_p->func_image_ext)) 
 	  return -1; // return, if func_image returns != 0
-	
       }	else
 	if(vc_gdm70x_verbose > 2)
 	  fputs("vc_gdm70x_do: picture dropped.\n",stderr);
-
-    } 
-    else {
-      do{
-	if( (bytes = vc_gdm70x_read(gdm_p,buffer + i, 26 - i)) <= 0) {
-	  if(vc_gdm70x_verbose > 1)
-	    fputs("vc_gdm70x_do: read failed.\n",stderr);
-	  return -1;
-	}
-	i+= bytes;
-      } while ( i < 26);
-
-      if( buffer[25] != 0x03) {
-	if(vc_gdm70x_verbose > 1)
-	  fputs("vc_gdm70x_do: sync lost.\n",stderr);
-	gdm_p->sync = 0;
-	return -1;
-      }
-
-
-      if( vc_gdm70x_parsevalue(buffer+13,&(gdm_p->data2)))
-	return -1;
-      if( vc_gdm70x_parsevalue(buffer+1,&(gdm_p->data1)))
-	return -1;
-
+      break;
+    case VC_GDM70X_DATA:
       if(gdm_p->func_data && !skip)
 	if( gdm_p->func_data(gdm_p,gdm_p->func_data_ext))
 	  return -1; // return, if func_data returns != 0
-	
+      break;
+    case VC_GDM70X_NONE:
+      break;
+    default:
+      return -1;
     }
 
-    if( ioctl(gdm_p->fd,FIONREAD, &bytes) < 0) {
+    if(gdm_p->replay)
+      bytes = vc_gdm70x_capture_pending(gdm_p->replay);
+    else if( ioctl(gdm_p->fd,FIONREAD, &bytes) < 0) {
       if(vc_gdm70x_verbose)
 	perror("vc_gdm70x_do: ioctl failed");
       return -1;
@@ -365,6 +552,71 @@ vc_gdm70x_do(struct vc_gdm70x* gdm_p, int skip)
   return 0;
 }
 
+void
+vc_gdm70x_getrecord(const struct vc_gdm70x* gdm_p, struct vc_gdm70x_record* rec_p)
+{
+  assert(gdm_p);
+  assert(rec_p);
+
+  rec_p->ts    = gdm_p->ts;
+  rec_p->data1 = gdm_p->data1;
+  rec_p->data2 = gdm_p->data2;
+}
+
+size_t
+vc_gdm70x_framesize(const unsigned char* buf, size_t len)
+{
+  size_t size;
+
+  assert(buf);
+
+  if(len < 2 || buf[0] != 0x02)
+    return 0;
+
+  size = (buf[1] == 'Z') ? VC_GDM70X_FRAME_IMAGE : VC_GDM70X_FRAME_DATA;
+
+  if(len < size || buf[size - 1] != 0x03)
+    return 0;
+
+  return size;
+}
+
+int
+vc_gdm70x_parseframe(const unsigned char* frame, struct vc_gdm70x_record* rec_p)
+{
+  char buffer[VC_GDM70X_FRAME_DATA];
+
+  assert(frame);
+  assert(rec_p);
+
+  /* vc_gdm70x_parsevalue modifies the string */
+  memcpy(buffer,frame,VC_GDM70X_FRAME_DATA);
+
+  if( vc_gdm70x_parsevalue(buffer+13,&(rec_p->data2)))
+    return -1;
+  if( vc_gdm70x_parsevalue(buffer+1,&(rec_p->data1)))
+    return -1;
+
+  return 0;
+}
+
+double
+vc_gdm70x_data_si(const struct vc_gdm70x_data* data_p)
+{
+  assert(data_p);
+
+  switch(data_p->mult)
+    {
+    case NANO:  return data_p->value * 1e-9;
+    case MICRO: return data_p->value * 1e-6;
+    case MILLI: return data_p->value * 1e-3;
+    case KILO:  return data_p->value * 1e3;
+    case MEGA:  return data_p->value * 1e6;
+    case OVER:  return NAN;
+    default:    return data_p->value;
+    }
+}
+
 
 int 
 vc_gdm70x_parsevalue(const char* str, struct vc_gdm70x_data* data_p) 
@@ -445,6 +697,32 @@ vc_gdm70x_parsevalue(const char* str, struct vc_gdm70x_data* data_p)
   return 0;
 }
 
+/* vc_gdm70x_idle: wait for bytes of the meter calling func_idle, returns 0
+   if none arrived before the read would time out */
+static int
+vc_gdm70x_idle(struct vc_gdm70x* gdm_p)
+{
+#ifdef HAVE_POLL_H
+  struct pollfd pfd;
+  int waited;
+
+  pfd.fd = gdm_p->fd;
+  pfd.events = POLLIN;
+
+  for(waited = 0; waited < READ_TIMEOUT; waited += gdm_p->idle_ms) {
+    if(poll(&pfd, 1, gdm_p->idle_ms) != 0)
+      return 1;
+
+    if(gdm_p->func_idle(gdm_p, gdm_p->func_idle_ext))
+      return 0;
+  }
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
 int
 vc_gdm70x_read(struct vc_gdm70x* gdm_p, void* buf, const int size) 
 {
@@ -456,14 +734,37 @@ vc_gdm70x_read(struct vc_gdm70x* gdm_p, void* buf, const int size)
   assert(buf);
 
   while(i < size) {
-    if( (bytes = read(gdm_p->fd,(char*)buf+i,size - i)) == 0) {
+    if(gdm_p->replay)
+      bytes = vc_gdm70x_capture_read(gdm_p->replay,(char*)buf+i,size - i);
+    else if(gdm_p->func_idle && !vc_gdm70x_idle(gdm_p))
+      bytes = 0;
+    else
+      bytes = read(gdm_p->fd,(char*)buf+i,size - i);
+
+    if(bytes == 0) {
       if(vc_gdm70x_verbose > 2)
 	{
 	  fputs("vc_gdm70x_read: read timeout.\n",stderr);
 	}
       gdm_p->sync = 0;
       return -1;
+    } else if(bytes < 0) {
+      if(errno == EINTR)
+	continue;
+
+      gdm_p->error = errno;
+      if(vc_gdm70x_verbose > 1)
+	perror("vc_gdm70x_read: read failed");
+      gdm_p->sync = 0;
+      return -1;
     }
+
+    if(gdm_p->tap && vc_gdm70x_capture_write(gdm_p->tap,(char*)buf+i,bytes)) {
+      if(vc_gdm70x_verbose)
+	fputs("vc_gdm70x_read: tap failed, stopped tapping.\n",stderr);
+      vc_gdm70x_tap(gdm_p,0);
+    }
+
     i += bytes;
   }
 
@@ -0,0 +1,93 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_ARCHIVE__
+#define __VC_GDM70X_ARCHIVE__
+
+#include "vc-gdm70x.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An archive stores a stream of images in a single file. Each image is
+   appended as one entry holding the timestamp and either the packed bitmap
+   (keyframe) or a delta against the last keyframe. Closing an archive
+   opened for writing appends an index with the offset of every entry,
+   which is used to seek by time. Archives lacking the index (e.g. the
+   writer crashed) are recovered by scanning the entries. */
+
+enum vc_gdm70x_archive_mode {
+  VC_GDM70X_ARCHIVE_READ   = 0,
+  VC_GDM70X_ARCHIVE_APPEND = 1,
+};
+
+struct vc_gdm70x_archive_index {
+  struct timespec ts;
+  unsigned long long offset;
+  unsigned long key;  /* number of the keyframe of this entry */
+  int size;           /* size of the payload */
+  int delta;          /* payload is a delta against the keyframe */
+};
+
+struct vc_gdm70x_archive {
+  int fd;
+  int mode;
+
+  unsigned long count; /* number of images in the archive */
+  unsigned long alloc;
+  struct vc_gdm70x_archive_index* index;
+
+  unsigned long long end; /* offset behind the last entry */
+
+  /* writer state */
+  int keyframe_interval;
+  int delta_count;
+  int key_valid;
+  unsigned char key[VC_GDM70X_IMAGE_SIZE];
+};
+
+/* vc_gdm70x_archive_open: open an archive for reading or appending */
+extern struct vc_gdm70x_archive* vc_gdm70x_archive_open(const char* filename, int mode);
+
+/* vc_gdm70x_archive_close: close the archive, writing the index if appending */
+extern int vc_gdm70x_archive_close(struct vc_gdm70x_archive* ar_p);
+
+/* vc_gdm70x_archive_setkeyframe: store up to count deltas after a keyframe */
+extern int vc_gdm70x_archive_setkeyframe(struct vc_gdm70x_archive* ar_p, int count);
+
+/* vc_gdm70x_archive_append: append an image */
+extern int vc_gdm70x_archive_append(struct vc_gdm70x_archive* ar_p,
+				    const struct timespec* ts,
+				    const unsigned char* image);
+
+/* vc_gdm70x_archive_find: number of the last image received at or before ts,
+   -1 if there is none */
+extern long vc_gdm70x_archive_find(struct vc_gdm70x_archive* ar_p,
+				   const struct timespec* ts);
+
+/* vc_gdm70x_archive_get: read image n and its timestamp */
+extern int vc_gdm70x_archive_get(struct vc_gdm70x_archive* ar_p, unsigned long n,
+				 struct timespec* ts, unsigned char* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_CAPTURE__
+#define __VC_GDM70X_CAPTURE__
+
+#include "vc-gdm70x.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A capture file holds the raw byte stream received from the meter. It
+   starts with a header holding the realtime and monotonic clock at the
+   time the capture was created, followed by one chunk per read: the
+   monotonic time in nanoseconds, the number of bytes and the bytes.
+   A handle opened with vc_gdm70x_open_replay decodes a capture instead
+   of a tty, timestamps are recovered from the chunks. */
+
+#define VC_GDM70X_CAPTURE_MAGIC "GDM70XT"
+
+/* size of the file header and of the chunk headers */
+#define VC_GDM70X_CAPTURE_HEADER 32
+#define VC_GDM70X_CAPTURE_CHUNK  12
+
+#define VC_GDM70X_CAPTURE_BUFFER 65536
+
+enum vc_gdm70x_capture_mode {
+  VC_GDM70X_CAPTURE_TAP    = 0, /* writing */
+  VC_GDM70X_REPLAY_FAST    = 1, /* reading as fast as possible */
+  VC_GDM70X_REPLAY_PACED   = 2, /* reading with the original timing */
+};
+
+struct vc_gdm70x_capture {
+  int fd;
+  int mode;
+
+  unsigned long long real;   /* clocks when the capture was created, ns */
+  unsigned long long mono;
+
+  /* replay state */
+  unsigned long long chunk;  /* monotonic time of the current chunk */
+  size_t left;               /* bytes left in the current chunk */
+  int eof;
+  int started;
+  unsigned long long first;  /* monotonic time of the first chunk */
+  struct timespec start;     /* monotonic time the replay started */
+
+  size_t pos, len;
+  unsigned char buf[VC_GDM70X_CAPTURE_BUFFER];
+};
+
+/* vc_gdm70x_tap: copy all bytes received by gdm_p into a new capture
+   file, NULL stops tapping. The tap is kept when the device is reopened */
+extern int vc_gdm70x_tap(struct vc_gdm70x* gdm_p, const char* filename);
+
+/* vc_gdm70x_open_replay: open a capture file instead of a device, mode
+   is VC_GDM70X_REPLAY_FAST or VC_GDM70X_REPLAY_PACED. vc_gdm70x_check
+   fails once the whole capture was read */
+extern int vc_gdm70x_open_replay(struct vc_gdm70x* gdm_p, const char* filename,
+				 int mode);
+
+/* vc_gdm70x_capture_start: realtime a replayed capture was started */
+extern int vc_gdm70x_capture_start(const struct vc_gdm70x* gdm_p,
+				   struct timespec* ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
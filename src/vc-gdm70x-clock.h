@@ -0,0 +1,81 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_CLOCK__
+#define __VC_GDM70X_CLOCK__
+
+#include "vc-gdm70x.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The GDM sends its records at a fixed rate, but the host timestamps
+   jitter by several milliseconds. The clock estimator numbers the
+   records by the meter's sample clock and fits a line through the
+   arrival times of the last window records. The value of the line at
+   the newest record is its smoothed timestamp. Records the meter sent
+   but which got lost show up as a jump of the index. */
+
+#define VC_GDM70X_CLOCK_WINDOW 64
+
+/* records fitted before lost records are detected */
+#define VC_GDM70X_CLOCK_BOOTSTRAP 8
+
+struct vc_gdm70x_clock_point {
+  long long index;
+  struct timespec ts;    /* arrival time */
+};
+
+struct vc_gdm70x_clock {
+  int window;
+  int count;             /* points in the window */
+  int head;              /* oldest point */
+  struct vc_gdm70x_clock_point* point;
+
+  long long index;       /* sample index of the last record */
+  double period;         /* estimated time between two records, s */
+  struct timespec ts;    /* smoothed time of the last record */
+  unsigned long missing; /* records lost so far */
+};
+
+/* vc_gdm70x_clock_create: create an estimator fitting window records */
+extern struct vc_gdm70x_clock* vc_gdm70x_clock_create(int window);
+
+/* vc_gdm70x_clock_destroy: destroy an estimator */
+extern void vc_gdm70x_clock_destroy(struct vc_gdm70x_clock* clk_p);
+
+/* vc_gdm70x_clock_reset: forget all records, e.g. after reopening */
+extern void vc_gdm70x_clock_reset(struct vc_gdm70x_clock* clk_p);
+
+/* vc_gdm70x_clock_update: add the arrival time of the next record, index
+   and ts of clk_p are updated. Returns the number of records lost
+   before this one */
+extern long vc_gdm70x_clock_update(struct vc_gdm70x_clock* clk_p,
+				   const struct timespec* ts);
+
+/* vc_gdm70x_clock_func: data callback replacing ts of gdm_p by the
+   smoothed time, to be called before other callbacks */
+extern int vc_gdm70x_clock_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
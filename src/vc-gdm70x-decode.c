@@ -0,0 +1,754 @@
+/*
+This program decodes captures and tslogs written by vc-gdm70x, a tool
+using libvc-gdm70x, a library to connect to Voltcraft GDM 70x Multimeters
+via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../config.h"
+#include "vc-gdm70x.h"
+#include "vc-gdm70x-capture.h"
+#include "vc-gdm70x-sink.h"
+#include "vc-gdm70x-tslog.h"
+#include "libvc-gdm70x-private.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <assert.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The capture is decoded in rounds. Each round the stream is split into
+   one segment per thread at chunk boundaries. A thread copies the bytes
+   of its segment (and of the following chunks for a step crossing the
+   end) and decodes it in steps following the rules of vc_gdm70x_do: a
+   step either syncs, dropping the frame synced on, or receives a frame,
+   losing sync if it does not start with STX or end with ETX.
+
+   The state at the start of a segment is not known, so the thread starts
+   syncing there. While merging, the sequential scan is continued from
+   where the previous segment ended until it reaches a step the thread
+   took too, i.e. at the same position and in the same state. From there
+   both scans are the same, so the result is always the same as
+   vc-gdm70x --replay of the capture. */
+
+const struct option longopts [] = {
+  { "check",no_argument,0,'c'},
+  { "jobs", required_argument,0,'j'},
+  { "output", required_argument,0,'o'},
+  { "segment", required_argument,0,'s'},
+  { "verbose",no_argument,0,'v'},
+  { "version",no_argument,0,'V'},
+  { "help",no_argument,0,'h'},
+  {0,0,0,0}
+};
+
+#define MAX_JOBS 256
+
+/* bytes a step reads at most: vc_gdm70x_sync searches 1026 bytes for STX
+   and reads the rest of the frame found */
+#define MAX_STEP (1026 + VC_GDM70X_FRAME_IMAGE)
+
+enum step_state {
+  STEP_SYNC = 0,  /* not synced, the step syncs */
+  STEP_RECV = 1,  /* synced, the step receives a frame */
+  STEP_END  = 2,  /* the stream ended */
+};
+
+struct step {
+  unsigned long long pos; /* offset in the stream */
+  int state;
+  size_t out;             /* offset of the encoded record in the output */
+  unsigned long records;  /* records of the job before this step */
+};
+
+struct chunk {
+  unsigned long long pos; /* offset in the stream */
+  unsigned long long time;
+};
+
+struct job {
+  /* segment */
+  size_t file;               /* offset of the first chunk in the file */
+  unsigned long long start;  /* offset of the segment in the stream */
+  unsigned long long end;
+
+  /* bytes of the segment and following chunks */
+  unsigned char* buf;
+  size_t len;
+  struct chunk* chunks;
+  size_t nchunks;
+
+  /* scan results */
+  struct step* steps;
+  size_t count, alloc;
+  unsigned long long next;   /* first step behind the segment */
+  int state;                 /* state of that step */
+  char* out;
+  size_t out_len, out_alloc;
+  unsigned long records;
+  int error;
+};
+
+static int verbose = 0;
+static int output_type = VC_GDM70X_SINK_CSV;
+
+/* records written, kept for --check */
+static int keep = 0;
+static char* kept;
+static size_t kept_len, kept_alloc;
+
+static const unsigned char* map;
+static size_t map_size;
+static unsigned long long capture_real, capture_mono;
+
+/* chunk_time: realtime the byte at pos was received */
+static void chunk_time(const struct job* job_p, unsigned long long pos,
+		       struct timespec* ts)
+{
+  size_t lo = 0, hi = job_p->nchunks, mid;
+  unsigned long long t;
+
+  while(hi - lo > 1) {
+    mid = (lo + hi) / 2;
+    if(job_p->chunks[mid].pos <= pos)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  t = capture_real + (job_p->chunks[lo].time - capture_mono);
+  ts->tv_sec  = t / 1000000000ULL;
+  ts->tv_nsec = t % 1000000000ULL;
+}
+
+static int grow(void** ptr, size_t* alloc, size_t need, size_t size)
+{
+  size_t n = *alloc ? *alloc : 1024;
+  void* p;
+
+  if(need <= *alloc)
+    return 0;
+
+  while(n < need)
+    n *= 2;
+
+  p = realloc(*ptr, n * size);
+  if(!p)
+    return -1;
+
+  *ptr = p;
+  *alloc = n;
+  return 0;
+}
+
+/* decode_step: take the step of vc_gdm70x_do at local offset *p in the
+   given state and append a record received to out. Returns the state of
+   the next step, STEP_END if the stream ends within this step */
+static int decode_step(struct job* job_p, size_t* p, int state, char** out,
+		       size_t* out_len, size_t* out_alloc, unsigned long* records)
+{
+  const unsigned char* buf = job_p->buf;
+  struct vc_gdm70x_record rec;
+  size_t q = *p, size;
+  int i, n;
+
+  if(state == STEP_SYNC) {
+    /* vc_gdm70x_sync only checks the ETX of the frame following STX and
+       expects 1027 bytes for an image */
+    for(i = 1026; i > 0; i--) {
+      if(q >= job_p->len)
+	return STEP_END;
+      if(buf[q++] != 0x02)
+	continue;
+
+      if(q >= job_p->len)
+	return STEP_END;
+      size = (buf[q++] == 'Z') ? 1025 : 24;
+
+      if(q + size > job_p->len)
+	return STEP_END;
+      q += size;
+
+      *p = q;
+      return (buf[q - 1] == 0x03) ? STEP_RECV : STEP_SYNC;
+    }
+
+    *p = q;
+    return STEP_SYNC;
+  }
+
+  /* vc_gdm70x_receive reads two bytes before checking STX */
+  if(q + 2 > job_p->len)
+    return STEP_END;
+
+  if(buf[q] != 0x02) {
+    *p = q + 2;
+    return STEP_SYNC;
+  }
+
+  size = (buf[q + 1] == 'Z') ? VC_GDM70X_FRAME_IMAGE : VC_GDM70X_FRAME_DATA;
+  if(q + size > job_p->len)
+    return STEP_END;
+
+  *p = q + size;
+
+  if(vc_gdm70x_framesize(buf + q, size) != size)
+    return STEP_SYNC;
+
+  /* images are skipped, a record failing to parse is dropped */
+  if(size == VC_GDM70X_FRAME_IMAGE || vc_gdm70x_parseframe(buf + q, &rec))
+    return STEP_RECV;
+
+  /* the time is taken when the first two bytes are read */
+  chunk_time(job_p, job_p->start + q + 1, &rec.ts);
+
+  if(grow((void**) out, out_alloc, *out_len + 256, 1)) {
+    job_p->error = ENOMEM;
+    return STEP_END;
+  }
+
+  n = vc_gdm70x_format_record(output_type, &rec, *out + *out_len, 256);
+  if(n < 0) {
+    job_p->error = EINVAL;
+    return STEP_END;
+  }
+  *out_len += n;
+  ++*records;
+
+  return STEP_RECV;
+}
+
+/* job_copy: gather the bytes and chunk times of the segment */
+static int job_copy(struct job* job_p)
+{
+  size_t file = job_p->file, size, alloc = 0, calloc = 0;
+  unsigned long long pos = job_p->start;
+  unsigned long long need = job_p->end - job_p->start + MAX_STEP;
+
+  while(file + VC_GDM70X_CAPTURE_CHUNK <= map_size && job_p->len < need) {
+    size = vc_gdm70x_get32(map + file + 8);
+    if(size > map_size - file - VC_GDM70X_CAPTURE_CHUNK)
+      size = map_size - file - VC_GDM70X_CAPTURE_CHUNK;
+
+    if(grow((void**) &job_p->buf, &alloc, job_p->len + size, 1) ||
+       grow((void**) &job_p->chunks, &calloc, job_p->nchunks + 1,
+	    sizeof(struct chunk)))
+      return -1;
+
+    job_p->chunks[job_p->nchunks].pos  = pos;
+    job_p->chunks[job_p->nchunks].time = vc_gdm70x_get64(map + file);
+    job_p->nchunks++;
+
+    memcpy(job_p->buf + job_p->len, map + file + VC_GDM70X_CAPTURE_CHUNK, size);
+    job_p->len += size;
+    pos += size;
+    file += VC_GDM70X_CAPTURE_CHUNK + size;
+  }
+
+  return 0;
+}
+
+static void* job_run(void* ptr)
+{
+  struct job* job_p = ptr;
+  size_t p = 0, seg;
+  int state = STEP_SYNC;
+
+  if(job_copy(job_p)) {
+    job_p->error = ENOMEM;
+    return 0;
+  }
+
+  seg = job_p->end - job_p->start;
+
+  while(p < seg && state != STEP_END && !job_p->error) {
+    if(grow((void**) &job_p->steps, &job_p->alloc, job_p->count + 1,
+	    sizeof(struct step))) {
+      job_p->error = ENOMEM;
+      break;
+    }
+
+    job_p->steps[job_p->count].pos = job_p->start + p;
+    job_p->steps[job_p->count].state = state;
+    job_p->steps[job_p->count].out = job_p->out_len;
+    job_p->steps[job_p->count].records = job_p->records;
+    job_p->count++;
+
+    state = decode_step(job_p, &p, state, &job_p->out, &job_p->out_len,
+			&job_p->out_alloc, &job_p->records);
+  }
+
+  job_p->next = job_p->start + p;
+  job_p->state = state;
+
+  return 0;
+}
+
+static void job_free(struct job* job_p)
+{
+  free(job_p->buf);
+  free(job_p->chunks);
+  free(job_p->steps);
+  free(job_p->out);
+  memset(job_p, 0, sizeof(struct job));
+}
+
+static int write_all(int fd, const char* buf, size_t size)
+{
+  ssize_t n;
+
+  if(keep) {
+    if(grow((void**) &kept, &kept_alloc, kept_len + size, 1)) {
+      fputs("vc-gdm70x-decode: out of memory.\n",stderr);
+      return -1;
+    }
+    memcpy(kept + kept_len, buf, size);
+    kept_len += size;
+  }
+
+  while(size > 0) {
+    n = write(fd, buf, size);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0) {
+      perror("vc-gdm70x-decode: write failed");
+      return -1;
+    }
+    buf += n;
+    size -= n;
+  }
+
+  return 0;
+}
+
+/* find_step: index of the step taken at pos in state, -1 if the job did
+   not take it */
+static long find_step(const struct job* job_p, unsigned long long pos, int state)
+{
+  size_t lo = 0, hi = job_p->count, mid;
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(job_p->steps[mid].pos < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (lo < job_p->count && job_p->steps[lo].pos == pos &&
+	  job_p->steps[lo].state == state) ? (long) lo : -1;
+}
+
+/* job_merge: write the records of the job, the sequential scan continues
+   at *pos in *state, which are updated */
+static int job_merge(struct job* job_p, int fd, unsigned long long* pos,
+		     int* state, unsigned long* records, unsigned long* resync)
+{
+  char* out = 0;
+  size_t out_len = 0, out_alloc = 0, p;
+  long i = -1;
+  int retval;
+
+  /* like vc-gdm70x, give up if the first sync fails */
+  if(*pos == 0 && *state == STEP_SYNC) {
+    p = 0;
+    if(decode_step(job_p, &p, STEP_SYNC, &out, &out_len, &out_alloc,
+		   records) != STEP_RECV) {
+      if(!job_p->error)
+	fputs("vc-gdm70x-decode: sync failed.\n",stderr);
+      return -1;
+    }
+  }
+
+  /* unless the sequential scan reaches a step of the job at once, scan
+     again until both take the same step */
+  if(*state != STEP_END && *pos < job_p->end &&
+     (i = find_step(job_p, *pos, *state)) < 0) {
+    (*resync)++;
+
+    do {
+      p = *pos - job_p->start;
+      *state = decode_step(job_p, &p, *state, &out, &out_len, &out_alloc,
+			   records);
+      *pos = job_p->start + p;
+    } while(*state != STEP_END && *pos < job_p->end &&
+	    (i = find_step(job_p, *pos, *state)) < 0);
+
+    retval = job_p->error ? -1 : write_all(fd, out, out_len);
+    free(out);
+
+    if(retval)
+      return retval;
+  }
+
+  /* the rest is the same as decoded by the job */
+  if(i < 0)
+    return 0;
+
+  *records += job_p->records - job_p->steps[i].records;
+  *pos = job_p->next;
+  *state = job_p->state;
+
+  return write_all(fd, job_p->out + job_p->steps[i].out,
+		   job_p->out_len - job_p->steps[i].out);
+}
+
+struct check {
+  size_t offset;  /* records compared so far, in bytes of the output */
+  unsigned long records;
+  int differs;
+};
+
+/* check_record: compare a record of vc_gdm70x_do with the one written */
+static int check_record(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  struct check* check_p = ptr;
+  struct vc_gdm70x_record rec;
+  char buf[256];
+  int n;
+
+  vc_gdm70x_getrecord(gdm_p, &rec);
+
+  n = vc_gdm70x_format_record(output_type, &rec, buf, sizeof(buf));
+  if(n < 0 || check_p->offset + n > kept_len ||
+     memcmp(kept + check_p->offset, buf, n)) {
+    check_p->differs = 1;
+    return -1;
+  }
+
+  check_p->offset += n;
+  check_p->records++;
+  return 0;
+}
+
+/* check_replay: decode the capture again the way vc-gdm70x --replay
+   does and compare the records with those written */
+static int check_replay(const char* filename)
+{
+  struct vc_gdm70x gdm;
+  struct check check;
+
+  memset(&check, 0, sizeof(check));
+  vc_gdm70x_init(&gdm);
+
+  if(vc_gdm70x_open_replay(&gdm, filename, VC_GDM70X_REPLAY_FAST)) {
+    fprintf(stderr,"vc-gdm70x-decode: vc_gdm70x_open_replay failed.\n");
+    return -1;
+  }
+
+  vc_gdm70x_setfunc_data(&gdm, check_record, &check);
+
+  /* the main loop of vc-gdm70x --replay */
+  if(vc_gdm70x_sync(&gdm) == 0)
+    while(!check.differs)
+      if(vc_gdm70x_do(&gdm, 0) && vc_gdm70x_check(&gdm))
+	break;
+
+  vc_gdm70x_fini(&gdm);
+
+  if(check.differs || check.offset != kept_len) {
+    fprintf(stderr,"vc-gdm70x-decode: check failed at record %lu.\n",
+	    check.records + 1);
+    return -1;
+  }
+
+  if(verbose)
+    fprintf(stderr,"vc-gdm70x-decode: check passed, %lu records are the same as replayed.\n",
+	    check.records);
+
+  return 0;
+}
+
+/* decode_tslog: write all records of a tslog, which is decoded in one go */
+static int decode_tslog(const char* filename, int fd, unsigned long* records)
+{
+  struct vc_gdm70x_tslog* log_p;
+  struct vc_gdm70x_record rec;
+  char buf[65536];
+  size_t len = 0;
+  int n, retval = 0;
+
+  log_p = vc_gdm70x_tslog_open(filename,VC_GDM70X_TSLOG_READ);
+  if(!log_p)
+    return -1;
+
+  while( (n = vc_gdm70x_tslog_read(log_p,&rec)) > 0) {
+    if(len + 512 > sizeof(buf)) {
+      if( (retval = write_all(fd,buf,len)))
+	break;
+      len = 0;
+    }
+
+    n = vc_gdm70x_format_record(output_type,&rec,buf + len,sizeof(buf) - len);
+    if(n < 0) {
+      retval = -1;
+      break;
+    }
+    len += n;
+    ++*records;
+  }
+
+  if(n < 0)
+    retval = -1;
+
+  if(!retval)
+    retval = write_all(fd,buf,len);
+
+  vc_gdm70x_tslog_close(log_p);
+  return retval;
+}
+
+void print_help()
+{
+  printf("vc-gdm70x-decode %s\n\n",VC_GDM70X_VERSION);
+  puts("Usage: vc-gdm70x-decode [options] CAPTURE\n");
+  puts("Decodes the records of a capture written by vc-gdm70x --tap using");
+  puts("several threads, images are skipped. The records are the same as");
+  puts("those of vc-gdm70x --replay. A tslog written by vc-gdm70x");
+  puts("--output=tslog:FILE is decoded too.\n");
+  puts("Options: (default values are in brackets)");
+  puts("  -c, --check                  decode the capture again like --replay");
+  puts("                               and compare the records");
+  puts("  -h, --help                   displays this help and exit");
+  puts("  -j, --jobs=COUNT             number of threads [number of cpus]");
+  puts("  -o, --output=TYPE:FILE       write the records to FILE ('-' for stdout)");
+  puts("                               as TYPE 'csv', 'jsonl' or 'bin' [csv:-]");
+  puts("  -s, --segment=BYTES          bytes decoded by a thread at once [8388608]");
+  puts("  -v, --verbose                makes output more noisy");
+  puts("  -V, --version                prints version info");
+}
+
+int main(int argc, char** argv)
+{
+  static struct job jobs[MAX_JOBS];
+  static const struct { const char* name; int type; } types[] = {
+    { "csv",   VC_GDM70X_SINK_CSV },
+    { "jsonl", VC_GDM70X_SINK_JSONL },
+    { "bin",   VC_GDM70X_SINK_BINARY },
+  };
+  pthread_t threads[MAX_JOBS];
+  struct stat st;
+  char header[VC_GDM70X_RECORD_HEADER + 64];
+  const char* p_output = "-";
+  const char* sep;
+  size_t file, size, segment = 8 * 1024 * 1024;
+  unsigned long long stream = 0, pos = 0;
+  unsigned long records = 0, resync = 0;
+  int c, n, fd, out_fd, tslog, check = 0, state = STEP_SYNC, retval = 0;
+  long njobs;
+
+  njobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* frames the threads probe at segment boundaries are no errors */
+  vc_gdm70x_verbose = 0;
+
+  while( (c=getopt_long(argc,argv,":cj:o:s:vhV",longopts,NULL)) != -1 )
+    {
+      switch(c) {
+      case 'c':
+	check = 1;
+	break;
+      case 'j':
+	njobs = atol(optarg);
+	if(njobs < 1 || njobs > MAX_JOBS) {
+	  fprintf(stderr,"vc-gdm70x-decode: jobs musst be between 1 and %i.\n",MAX_JOBS);
+	  retval = -1;
+	}
+	break;
+      case 'o':
+	p_output = optarg;
+	sep = strchr(optarg,':');
+	for(n = 0; sep && n < 3; n++)
+	  if(strlen(types[n].name) == (size_t) (sep - optarg) &&
+	     !strncmp(types[n].name,optarg,sep - optarg))
+	    break;
+	if(!sep || n == 3) {
+	  fprintf(stderr,"vc-gdm70x-decode: invalid output '%s'.\n",optarg);
+	  retval = -1;
+	} else {
+	  output_type = types[n].type;
+	  p_output = sep + 1;
+	}
+	break;
+      case 's':
+	segment = atol(optarg);
+	if(segment < 4 * VC_GDM70X_FRAME_IMAGE) {
+	  fprintf(stderr,"vc-gdm70x-decode: segment musst be at least %i bytes.\n",
+		  4 * VC_GDM70X_FRAME_IMAGE);
+	  retval = -1;
+	}
+	break;
+      case 'v':
+	++verbose;++vc_gdm70x_verbose;
+	break;
+      case ':':
+	fprintf(stderr,"vc-gdm70x-decode: option '-%c' requires an argument.\n",optopt);
+	retval = -1;
+	break;
+      case 'V':
+	printf("vc-gdm70x-decode %s\n",VC_GDM70X_VERSION);
+	exit(0);
+	break;
+      case 'h':
+	print_help();
+	exit(0);
+      case '?':
+      default:
+	fprintf(stderr,"vc-gdm70x-decode: unknown option '-%c'.\n",optopt);
+	retval = -1;
+	break;
+      }
+    }
+
+  if(optind != argc - 1) {
+    fprintf(stderr,"vc-gdm70x-decode: exactly one capture expected.\n");
+    retval = -1;
+  }
+
+  if(njobs < 1)
+    njobs = 1;
+  if(njobs > MAX_JOBS)
+    njobs = MAX_JOBS;
+
+  if(retval != 0)
+    {
+      fprintf(stderr,"vc-gdm70x-decode: errors encountered, exiting.\n");
+      exit(-1);
+    }
+
+  fd = open(argv[optind],O_RDONLY);
+  if(fd < 0 || fstat(fd,&st)) {
+    perror("vc-gdm70x-decode: open failed");
+    exit(-1);
+  }
+
+  map_size = st.st_size;
+
+  if(map_size < VC_GDM70X_TSLOG_HEADER ||
+     (map = mmap(0,map_size,PROT_READ,MAP_PRIVATE,fd,0)) == MAP_FAILED) {
+    fprintf(stderr,"vc-gdm70x-decode: '%s' is not a capture file.\n",argv[optind]);
+    exit(-1);
+  }
+
+  tslog = !memcmp(map,VC_GDM70X_TSLOG_MAGIC,8);
+
+  if(!tslog && (map_size < VC_GDM70X_CAPTURE_HEADER ||
+		memcmp(map,VC_GDM70X_CAPTURE_MAGIC,8) || vc_gdm70x_get32(map + 8) != 1)) {
+    fprintf(stderr,"vc-gdm70x-decode: '%s' is not a capture file.\n",argv[optind]);
+    exit(-1);
+  }
+
+  madvise((void*) map,map_size,MADV_SEQUENTIAL);
+
+  capture_real = vc_gdm70x_get64(map + 16);
+  capture_mono = vc_gdm70x_get64(map + 24);
+
+  if(strcmp(p_output,"-") == 0)
+    out_fd = STDOUT_FILENO;
+  else
+    out_fd = open(p_output,O_WRONLY | O_CREAT | O_TRUNC,0666);
+
+  if(out_fd < 0) {
+    perror("vc-gdm70x-decode: open failed");
+    exit(-1);
+  }
+
+  n = vc_gdm70x_format_header(output_type,header,sizeof(header));
+  if(n < 0 || write_all(out_fd,header,n))
+    exit(-1);
+
+  if(tslog)
+    retval = decode_tslog(argv[optind],out_fd,&records);
+
+  /* the header is not written by --replay */
+  keep = check && !tslog;
+
+  file = tslog ? map_size : VC_GDM70X_CAPTURE_HEADER;
+
+  while(file < map_size && !retval) {
+    /* split the next part of the stream at chunk boundaries */
+    for(n = 0; n < njobs && file < map_size; n++) {
+      jobs[n].file = file;
+      jobs[n].start = stream;
+
+      while(file + VC_GDM70X_CAPTURE_CHUNK <= map_size &&
+	    stream - jobs[n].start < segment) {
+	size = vc_gdm70x_get32(map + file + 8);
+	if(size > map_size - file - VC_GDM70X_CAPTURE_CHUNK)
+	  size = map_size - file - VC_GDM70X_CAPTURE_CHUNK;
+	file += VC_GDM70X_CAPTURE_CHUNK + size;
+	stream += size;
+      }
+
+      if(file + VC_GDM70X_CAPTURE_CHUNK > map_size)
+	file = map_size;
+
+      jobs[n].end = stream;
+    }
+
+    for(c = 0; c < n; c++)
+      if(pthread_create(threads + c,NULL,job_run,jobs + c)) {
+	fprintf(stderr,"vc-gdm70x-decode: pthread_create failed.\n");
+	exit(-1);
+      }
+
+    for(c = 0; c < n; c++)
+      pthread_join(threads[c],NULL);
+
+    for(c = 0; c < n && !retval; c++) {
+      if(!jobs[c].error)
+	retval = job_merge(jobs + c,out_fd,&pos,&state,&records,&resync);
+
+      if(jobs[c].error) {
+	fprintf(stderr,"vc-gdm70x-decode: %s.\n",strerror(jobs[c].error));
+	retval = -1;
+      }
+    }
+
+    for(c = 0; c < n; c++)
+      job_free(jobs + c);
+  }
+
+  /* an empty capture can not be synced either */
+  if(!tslog && !retval && stream == 0) {
+    fputs("vc-gdm70x-decode: sync failed.\n",stderr);
+    retval = -1;
+  }
+
+  if(verbose)
+    fprintf(stderr,"vc-gdm70x-decode: %llu bytes, %lu records, %lu segments rescanned.\n",
+	    stream,records,resync);
+
+  if(keep && !retval)
+    retval = check_replay(argv[optind]);
+
+  munmap((void*) map,map_size);
+  close(fd);
+
+  if(out_fd != STDOUT_FILENO && close(out_fd)) {
+    perror("vc-gdm70x-decode: close failed");
+    retval = -1;
+  }
+
+  return retval ? -1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_EXPR__
+#define __VC_GDM70X_EXPR__
+
+#include "vc-gdm70x.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Expressions are compiled once into the code of a small stack machine,
+   which is run for each record without any allocation. An expression
+   either calibrates a channel ("D1=D1*1.002-0.01") or defines a derived
+   value ("P=D1*D2"). Operands are D1 and D2 with their multiplier applied
+   (NAN on overflow), numbers with an optional multiplier n, u, m, k or M
+   and derived values defined before. Operators are + - * / and unary
+   minus, functions are abs(x), min(x,y) and max(x,y). Expressions are
+   evaluated in the order they were added. */
+
+#define VC_GDM70X_EXPR_COUNT 8   /* expressions per set */
+#define VC_GDM70X_EXPR_CODE  64  /* instructions per expression */
+#define VC_GDM70X_EXPR_STACK 16
+#define VC_GDM70X_EXPR_NAME  16
+
+enum vc_gdm70x_expr_op {
+  VC_GDM70X_EXPR_CONST = 0, /* push value */
+  VC_GDM70X_EXPR_D1,
+  VC_GDM70X_EXPR_D2,
+  VC_GDM70X_EXPR_LOAD,      /* push derived value arg */
+  VC_GDM70X_EXPR_ADD,
+  VC_GDM70X_EXPR_SUB,
+  VC_GDM70X_EXPR_MUL,
+  VC_GDM70X_EXPR_DIV,
+  VC_GDM70X_EXPR_NEG,
+  VC_GDM70X_EXPR_ABS,
+  VC_GDM70X_EXPR_MIN,
+  VC_GDM70X_EXPR_MAX,
+};
+
+struct vc_gdm70x_expr_insn {
+  int op;
+  int arg;
+  double value;
+};
+
+struct vc_gdm70x_expr_def {
+  char name[VC_GDM70X_EXPR_NAME];
+  int channel;           /* 1 or 2 if calibrating D1 or D2, else 0 */
+  int length;
+  struct vc_gdm70x_expr_insn code[VC_GDM70X_EXPR_CODE];
+};
+
+struct vc_gdm70x_expr {
+  int count;
+  struct vc_gdm70x_expr_def def[VC_GDM70X_EXPR_COUNT];
+  double value[VC_GDM70X_EXPR_COUNT]; /* results for the last record */
+};
+
+/* vc_gdm70x_expr_create: create an empty set of expressions */
+extern struct vc_gdm70x_expr* vc_gdm70x_expr_create(void);
+
+/* vc_gdm70x_expr_destroy: free a set of expressions */
+extern void vc_gdm70x_expr_destroy(struct vc_gdm70x_expr* expr_p);
+
+/* vc_gdm70x_expr_parse: compile "NAME=EXPR" and add it to the set. If
+   calib is set, NAME must be D1 or D2, otherwise a new name which is
+   not a function */
+extern int vc_gdm70x_expr_parse(struct vc_gdm70x_expr* expr_p, const char* spec,
+				int calib);
+
+/* vc_gdm70x_expr_find: index of the derived value name with len
+   characters, -1 if not defined */
+extern int vc_gdm70x_expr_find(const struct vc_gdm70x_expr* expr_p,
+			       const char* name, size_t len);
+
+/* vc_gdm70x_expr_eval: evaluate all expressions for a record, calibrated
+   values are stored into the record keeping their multiplier */
+extern void vc_gdm70x_expr_eval(struct vc_gdm70x_expr* expr_p,
+				struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_expr_derive: evaluate only the derived values for a record
+   which was calibrated already, e.g. one replayed by a trigger */
+extern void vc_gdm70x_expr_derive(struct vc_gdm70x_expr* expr_p,
+				  const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_expr_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_expr_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
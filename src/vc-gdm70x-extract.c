@@ -0,0 +1,311 @@
+/*
+This program extracts images from archives written by vc-gdm70x, a tool
+using libvc-gdm70x, a library to connect to Voltcraft GDM 70x Multimeters
+via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../config.h"
+#include "vc-gdm70x.h"
+#include "vc-gdm70x-archive.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <assert.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+const struct option longopts [] = {
+  { "list", no_argument,0,'l'},
+  { "frames", required_argument,0,'n'},
+  { "time", required_argument,0,'t'},
+  { "output", required_argument,0,'o'},
+  { "xpm", no_argument,0,'x'},
+  { "sequence", required_argument,0,'s'},
+  { "verbose",no_argument,0,'v'},
+  { "version",no_argument,0,'V'},
+  { "help",no_argument,0,'h'},
+  {0,0,0,0}
+};
+
+const char default_pbm[] = "GDM70X-%N.pbm";
+const char default_xpm[] = "GDM70X-%N.xpm";
+
+static int verbose = 0;
+
+/* parse_time: parse seconds since epoch with fraction, digit by digit
+   since a double can not hold nanoseconds */
+int parse_time(const char* str, char** end, struct timespec* ts)
+{
+  long scale = 100000000;
+
+  ts->tv_sec = strtoll(str,end,10);
+  if(*end == str)
+    return -1;
+
+  ts->tv_nsec = 0;
+
+  if(**end == '.')
+    for(++*end; (**end >= '0') && (**end <= '9'); ++*end, scale /= 10)
+      ts->tv_nsec += (**end - '0') * scale;
+
+  return 0;
+}
+
+/* parse_range: parse FROM[-TO] into first and last frame */
+int parse_range(struct vc_gdm70x_archive* ar_p, const char* str, int is_time,
+		long* first, long* last)
+{
+  char* end;
+  struct timespec ts;
+
+  if(is_time) {
+    if(parse_time(str,&end,&ts))
+      return -1;
+    /* the frame shown at the given time */
+    *first = vc_gdm70x_archive_find(ar_p,&ts);
+    if(*first < 0)
+      *first = 0;
+  } else {
+    *first = strtol(str,&end,10);
+    if(end == str)
+      return -1;
+  }
+
+  if(*end == 0) {
+    *last = *first;
+    return 0;
+  }
+
+  if(*end++ != '-')
+    return -1;
+
+  if(*end == 0) {
+    *last = (long) ar_p->count - 1;
+    return 0;
+  }
+
+  str = end;
+
+  if(is_time) {
+    if(parse_time(str,&end,&ts))
+      return -1;
+    *last = vc_gdm70x_archive_find(ar_p,&ts);
+  } else
+    *last = strtol(str,&end,10);
+
+  return (*end == 0) ? 0 : -1;
+}
+
+int format_filename(char* filename, size_t size, const char* format_string, long n)
+{
+  size_t i = 0;
+  int c;
+
+  while( (c = *(format_string++)) != 0 && i + 24 < size)
+    {
+      if(c != '%')
+	filename[i++] = c;
+      else
+	{
+	  switch(*(format_string++))
+	    {
+	    case 'N': i += sprintf(filename + i,"%04li",n); break;
+	    case '%': filename[i++] = '%'; break;
+	    default:
+	      fputs("vc-gdm70x-extract: format_filename: error in filename string.\n",stderr);
+	      return -1;
+	    }
+	}
+    }
+
+  filename[i] = 0;
+  return 0;
+}
+
+void print_help()
+{
+  printf("vc-gdm70x-extract %s\n\n",VC_GDM70X_VERSION);
+  puts("Usage: vc-gdm70x-extract [options] ARCHIVE\n");
+  puts("Options: (default values are in brackets)");
+  puts("  -h, --help                   displays this help and exit");
+  puts("  -l, --list                   list the images in the archive");
+  puts("  -n, --frames=FIRST[-[LAST]]  select images by number [all]");
+  puts("  -t, --time=FROM[-[TO]]       select images by time in seconds since epoch");
+  puts("  -o, --output=FORMAT          format of the filename of the images");
+  printf("                               [%s or %s]\n", default_pbm, default_xpm);
+  puts("  -x, --xpm                    write xpm instead of pbm images");
+  puts("  -s, --sequence=FILE          write all selected images as pbm sequence");
+  puts("                               into FILE, '-' for stdout");
+  puts("  -v, --verbose                makes output more noisy");
+  puts("  -V, --version                prints version info");
+  puts("\nFilename tokens:");
+  puts("  %N  number of the image as an at least 4 digit integer");
+  puts("  %%  character '%'");
+}
+
+int main(int argc, char** argv)
+{
+  struct vc_gdm70x_archive* ar_p;
+  unsigned char image[VC_GDM70X_IMAGE_SIZE];
+  struct timespec ts;
+  char filename[512];
+  FILE* fp;
+  long n, first = 0, last = -1;
+  int c;
+  int retval = 0;
+
+  int list = 0, xpm = 0;
+  const char* p_frames = 0;
+  const char* p_time = 0;
+  const char* p_output = 0;
+  const char* p_sequence = 0;
+
+  while( (c=getopt_long(argc,argv,":ln:t:o:xs:vhV",longopts,NULL)) != -1 )
+    {
+      switch(c) {
+      case 'l': list = 1; break;
+      case 'n': p_frames = optarg; break;
+      case 't': p_time = optarg; break;
+      case 'o': p_output = optarg; break;
+      case 'x': xpm = 1; break;
+      case 's': p_sequence = optarg; break;
+      case 'v':
+	++verbose;++vc_gdm70x_verbose;
+	break;
+      case ':':
+	fprintf(stderr,"vc-gdm70x-extract: option '-%c' requires an argument.\n",optopt);
+	retval = -1;
+	break;
+      case 'V':
+	printf("vc-gdm70x-extract %s\n",VC_GDM70X_VERSION);
+	exit(0);
+	break;
+      case 'h':
+	print_help();
+	exit(0);
+      case '?':
+      default:
+	fprintf(stderr,"vc-gdm70x-extract: unknown option '-%c'.\n",optopt);
+	retval = -1;
+	break;
+      }
+    }
+
+  if(optind != argc - 1) {
+    fprintf(stderr,"vc-gdm70x-extract: exactly one archive expected.\n");
+    retval = -1;
+  }
+
+  if(p_frames && p_time) {
+    fprintf(stderr,"vc-gdm70x-extract: --frames and --time are exclusive.\n");
+    retval = -1;
+  }
+
+  if(retval != 0)
+    {
+      fprintf(stderr,"vc-gdm70x-extract: errors encountered, exiting.\n");
+      exit(-1);
+    }
+
+  ar_p = vc_gdm70x_archive_open(argv[optind],VC_GDM70X_ARCHIVE_READ);
+
+  if(!ar_p) {
+    fprintf(stderr,"vc-gdm70x-extract: vc_gdm70x_archive_open failed.\n");
+    exit(-1);
+  }
+
+  last = (long) ar_p->count - 1;
+
+  if( (p_frames && parse_range(ar_p,p_frames,0,&first,&last)) ||
+      (p_time && parse_range(ar_p,p_time,1,&first,&last))) {
+    fprintf(stderr,"vc-gdm70x-extract: invalid range.\n");
+    vc_gdm70x_archive_close(ar_p);
+    exit(-1);
+  }
+
+  if(first < 0)
+    first = 0;
+  if(last >= (long) ar_p->count)
+    last = (long) ar_p->count - 1;
+
+  if(list) {
+    for(n = first; n <= last; n++) {
+      vc_gdm70x_archive_get(ar_p,n,&ts,0);
+      printf("%li %lld.%09li %s\n",n,(long long) ts.tv_sec,ts.tv_nsec,
+	     ar_p->index[n].delta ? "delta" : "key");
+    }
+    vc_gdm70x_archive_close(ar_p);
+    return 0;
+  }
+
+  fp = 0;
+
+  if(p_sequence) {
+    fp = strcmp(p_sequence,"-") ? fopen(p_sequence,"wb") : stdout;
+    if(!fp) {
+      perror("vc-gdm70x-extract: fopen failed");
+      vc_gdm70x_archive_close(ar_p);
+      exit(-1);
+    }
+  }
+
+  if(!p_output)
+    p_output = xpm ? default_xpm : default_pbm;
+
+  for(n = first; (n <= last) && !retval; n++) {
+    if(vc_gdm70x_archive_get(ar_p,n,&ts,image)) {
+      retval = -1;
+      break;
+    }
+
+    if(p_sequence) {
+      retval = vc_gdm70x_image_write_pbm(fp,image);
+      continue;
+    }
+
+    if(format_filename(filename,sizeof(filename),p_output,n)) {
+      retval = -1;
+      break;
+    }
+
+    if(verbose)
+      fprintf(stderr,"vc-gdm70x-extract: writing '%s'.\n",filename);
+
+    fp = fopen(filename,"wb");
+    if(!fp) {
+      perror("vc-gdm70x-extract: fopen failed");
+      retval = -1;
+      break;
+    }
+
+    if(xpm)
+      retval = vc_gdm70x_image_write_xpm(fp,image);
+    else
+      retval = vc_gdm70x_image_write_pbm(fp,image);
+
+    fclose(fp);
+    fp = 0;
+  }
+
+  if(fp && fp != stdout)
+    fclose(fp);
+
+  vc_gdm70x_archive_close(ar_p);
+
+  return retval ? -1 : 0;
+}
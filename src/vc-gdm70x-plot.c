@@ -0,0 +1,576 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "../config.h"
+#include "vc-gdm70x.h"
+#include "vc-gdm70x-sink.h"
+#include "vc-gdm70x-tslog.h"
+#include "libvc-gdm70x-private.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <assert.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* The records are downsampled in a single pass by Largest-Triangle-
+   Three-Buckets (Steinarsson, 2013). The number of records is taken from
+   the file headers, so the bucket of each record is known as it is read.
+   Instead of all points of a bucket only the minimum and maximum of
+   VC_GDM70X_PLOT_SUB parts of it are kept as candidates (MinMaxLTTB), thus
+   the memory needed depends on the number of points only. A bucket is
+   decided once the average of the following bucket is known. */
+
+const struct option longopts [] = {
+  { "points", required_argument,0,'n'},
+  { "channels", required_argument,0,'c'},
+  { "output", required_argument,0,'o'},
+  { "size", required_argument,0,'s'},
+  { "verbose",no_argument,0,'v'},
+  { "version",no_argument,0,'V'},
+  { "help",no_argument,0,'h'},
+  {0,0,0,0}
+};
+
+#define VC_GDM70X_PLOT_SUB 4
+
+enum { PLOT_SVG = 0, PLOT_PBM = 1 };
+
+struct point {
+  double x, y;
+};
+
+struct bucket {
+  long count;
+  double sx, sy;
+  int used[VC_GDM70X_PLOT_SUB];
+  struct point min[VC_GDM70X_PLOT_SUB], max[VC_GDM70X_PLOT_SUB];
+};
+
+struct channel {
+  int enabled;
+  int unit;
+  long points, max_points;
+  struct point* point;   /* selected points */
+  struct point last;     /* last point read */
+  double ymin, ymax;
+  long bucket;           /* number of the current bucket */
+  struct bucket pending, cur;
+};
+
+static int verbose = 0;
+static long long total = 0;  /* records in the file */
+static long target = 1000;   /* points per channel */
+
+static void bucket_add(struct bucket* b_p, int sub, const struct point* p)
+{
+  if(!b_p->used[sub] || p->y < b_p->min[sub].y)
+    b_p->min[sub] = *p;
+  if(!b_p->used[sub] || p->y > b_p->max[sub].y)
+    b_p->max[sub] = *p;
+
+  b_p->used[sub] = 1;
+  b_p->sx += p->x;
+  b_p->sy += p->y;
+  b_p->count++;
+}
+
+static void channel_push(struct channel* ch_p, const struct point* p)
+{
+  if(ch_p->points < ch_p->max_points)
+    ch_p->point[ch_p->points++] = *p;
+}
+
+/* channel_select: select the candidate of b_p spanning the largest
+   triangle with the last selected point and c_p */
+static void channel_select(struct channel* ch_p, const struct bucket* b_p,
+			   const struct point* c_p)
+{
+  const struct point* a_p = ch_p->point + ch_p->points - 1;
+  const struct point* best = 0;
+  const struct point* p;
+  double area, best_area = -1;
+  int i, j;
+
+  for(i = 0; i < VC_GDM70X_PLOT_SUB; i++) {
+    if(!b_p->used[i])
+      continue;
+
+    for(j = 0; j < 2; j++) {
+      p = j ? b_p->max + i : b_p->min + i;
+      area = (a_p->x - c_p->x) * (p->y - a_p->y) -
+	     (a_p->x - p->x) * (c_p->y - a_p->y);
+      if(area < 0)
+	area = -area;
+      if(area > best_area) {
+	best_area = area;
+	best = p;
+      }
+    }
+  }
+
+  if(best)
+    channel_push(ch_p,best);
+}
+
+static void channel_add(struct channel* ch_p, long long index, const struct point* p)
+{
+  struct point c;
+  long long pos;
+  long bucket;
+
+  if(ch_p->points == 0) {
+    ch_p->ymin = ch_p->ymax = p->y;
+    channel_push(ch_p,p);
+    ch_p->last = *p;
+    return;
+  }
+
+  if(p->y < ch_p->ymin)
+    ch_p->ymin = p->y;
+  if(p->y > ch_p->ymax)
+    ch_p->ymax = p->y;
+
+  ch_p->last = *p;
+
+  /* first and last point are kept, target - 2 buckets in between */
+  pos = index * (target - 2) * VC_GDM70X_PLOT_SUB / total;
+  bucket = pos / VC_GDM70X_PLOT_SUB;
+  if(bucket > target - 3)
+    bucket = target - 3;
+
+  if(bucket != ch_p->bucket) {
+    if(ch_p->cur.count) {
+      if(ch_p->pending.count) {
+	c.x = ch_p->cur.sx / ch_p->cur.count;
+	c.y = ch_p->cur.sy / ch_p->cur.count;
+	channel_select(ch_p,&(ch_p->pending),&c);
+      }
+      ch_p->pending = ch_p->cur;
+    }
+
+    memset(&(ch_p->cur),0,sizeof(ch_p->cur));
+    ch_p->bucket = bucket;
+  }
+
+  bucket_add(&(ch_p->cur),pos % VC_GDM70X_PLOT_SUB,p);
+}
+
+static void channel_finish(struct channel* ch_p)
+{
+  struct point c;
+
+  if(ch_p->points == 0)
+    return;
+
+  if(ch_p->pending.count) {
+    if(ch_p->cur.count) {
+      c.x = ch_p->cur.sx / ch_p->cur.count;
+      c.y = ch_p->cur.sy / ch_p->cur.count;
+    } else
+      c = ch_p->last;
+    channel_select(ch_p,&(ch_p->pending),&c);
+  }
+
+  if(ch_p->cur.count)
+    channel_select(ch_p,&(ch_p->cur),&(ch_p->last));
+
+  if(ch_p->point[ch_p->points - 1].x != ch_p->last.x ||
+     ch_p->point[ch_p->points - 1].y != ch_p->last.y)
+    channel_push(ch_p,&(ch_p->last));
+}
+
+/* plot area within the image */
+struct frame {
+  int width, height;
+  int left, right, top, bottom;
+  double x0, x1;
+};
+
+static double frame_x(const struct frame* f, double x)
+{
+  if(f->x1 <= f->x0)
+    return f->left;
+  return f->left + (x - f->x0) * (f->width - f->left - f->right) / (f->x1 - f->x0);
+}
+
+static double frame_y(const struct frame* f, const struct channel* ch_p, double y)
+{
+  if(ch_p->ymax <= ch_p->ymin)
+    return (f->height - f->bottom + f->top) / 2.0;
+  return f->height - f->bottom -
+    (y - ch_p->ymin) * (f->height - f->top - f->bottom) / (ch_p->ymax - ch_p->ymin);
+}
+
+static void write_svg(FILE* fp, const struct frame* f, const struct channel* ch,
+		      const struct timespec* t0)
+{
+  static const char* colors[2] = { "#1f5fbf", "#bf1f1f" };
+  char date[64];
+  struct tm tm;
+  time_t t = t0->tv_sec;
+  long i;
+  int c;
+
+  gmtime_r(&t,&tm);
+  strftime(date,sizeof(date),"%Y-%m-%d %H:%M:%S UTC",&tm);
+
+  fprintf(fp,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	  "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+	  "font-family=\"sans-serif\" font-size=\"11\">\n"
+	  "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n"
+	  "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"none\" stroke=\"black\"/>\n",
+	  f->width,f->height,f->left,f->top,f->width - f->left - f->right,
+	  f->height - f->top - f->bottom);
+
+  fprintf(fp,"<text x=\"%d\" y=\"%d\">0 s</text>\n"
+	  "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\">%s</text>\n"
+	  "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.3f s</text>\n",
+	  f->left,f->height - f->bottom + 14,
+	  f->width / 2,f->height - f->bottom + 14,date,
+	  f->width - f->right,f->height - f->bottom + 14,f->x1 - f->x0);
+
+  for(c = 0; c < 2; c++) {
+    if(!ch[c].points)
+      continue;
+
+    fprintf(fp,"<g fill=\"%s\" text-anchor=\"%s\">\n"
+	    "<text x=\"%d\" y=\"%d\">%g %s</text>\n"
+	    "<text x=\"%d\" y=\"%d\">%g %s</text>\n</g>\n",
+	    colors[c],c ? "start" : "end",
+	    c ? f->width - f->right + 4 : f->left - 4,f->top + 10,
+	    ch[c].ymax,vc_gdm70x_unit_name(ch[c].unit),
+	    c ? f->width - f->right + 4 : f->left - 4,f->height - f->bottom,
+	    ch[c].ymin,vc_gdm70x_unit_name(ch[c].unit));
+
+    fprintf(fp,"<polyline fill=\"none\" stroke=\"%s\" stroke-width=\"1\" points=\"",
+	    colors[c]);
+    for(i = 0; i < ch[c].points; i++)
+      fprintf(fp,"%s%.1f,%.1f",i ? " " : "",
+	      frame_x(f,ch[c].point[i].x),frame_y(f,ch + c,ch[c].point[i].y));
+    fputs("\"/>\n",fp);
+  }
+
+  fputs("</svg>\n",fp);
+}
+
+/* pixel: round without libm */
+static int pixel(double v)
+{
+  return (int) ((v < 0) ? v - 0.5 : v + 0.5);
+}
+
+static void pbm_set(unsigned char* bits, const struct frame* f, int x, int y)
+{
+  if(x >= 0 && x < f->width && y >= 0 && y < f->height)
+    bits[y * ((f->width + 7) / 8) + x / 8] |= 0x80 >> (x % 8);
+}
+
+static void pbm_line(unsigned char* bits, const struct frame* f,
+		     int x0, int y0, int x1, int y1)
+{
+  int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+  int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+  int err = dx + dy;
+
+  for(;;) {
+    pbm_set(bits,f,x0,y0);
+    if(x0 == x1 && y0 == y1)
+      break;
+    if(2 * err >= dy) {
+      err += dy;
+      x0 += sx;
+    }
+    if(2 * err <= dx) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+static int write_pbm(FILE* fp, const struct frame* f, const struct channel* ch)
+{
+  unsigned char* bits;
+  size_t size = (size_t) ((f->width + 7) / 8) * f->height;
+  int x0, y0, x1, y1, c;
+  long i;
+
+  bits = calloc(size,1);
+  if(!bits) {
+    fputs("vc-gdm70x-plot: calloc failed.\n",stderr);
+    return -1;
+  }
+
+  x0 = f->left; y0 = f->top;
+  x1 = f->width - f->right - 1; y1 = f->height - f->bottom - 1;
+  pbm_line(bits,f,x0,y0,x1,y0);
+  pbm_line(bits,f,x1,y0,x1,y1);
+  pbm_line(bits,f,x1,y1,x0,y1);
+  pbm_line(bits,f,x0,y1,x0,y0);
+
+  for(c = 0; c < 2; c++)
+    for(i = 1; i < ch[c].points; i++)
+      pbm_line(bits,f,
+	       pixel(frame_x(f,ch[c].point[i - 1].x)),
+	       pixel(frame_y(f,ch + c,ch[c].point[i - 1].y)),
+	       pixel(frame_x(f,ch[c].point[i].x)),
+	       pixel(frame_y(f,ch + c,ch[c].point[i].y)));
+
+  fprintf(fp,"P4\n%d %d\n",f->width,f->height);
+  fwrite(bits,1,size,fp);
+  free(bits);
+
+  return 0;
+}
+
+void print_help()
+{
+  printf("vc-gdm70x-plot %s\n\n",VC_GDM70X_VERSION);
+  puts("Usage: vc-gdm70x-plot [options] FILE\n");
+  puts("Plots the records of a binary record file or tslog written by");
+  puts("vc-gdm70x --output. Each channel is downsampled to a number of");
+  puts("points by Largest-Triangle-Three-Buckets, choosing among the");
+  puts("minima and maxima of the buckets. The file is read only once.\n");
+  puts("Options: (default values are in brackets)");
+  puts("  -c, --channels=LIST          channels to plot, '1', '2' or '12' [12]");
+  puts("  -h, --help                   displays this help and exit");
+  puts("  -n, --points=COUNT           points per channel [1000]");
+  puts("  -o, --output=TYPE:FILE       write the plot to FILE ('-' for stdout)");
+  puts("                               as TYPE 'svg' or 'pbm' [svg:-]");
+  puts("  -s, --size=WIDTHxHEIGHT      size of the plot in pixels [800x300]");
+  puts("  -v, --verbose                makes output more noisy");
+  puts("  -V, --version                prints version info");
+}
+
+int main(int argc, char** argv)
+{
+  struct channel ch[2];
+  struct frame f;
+  struct stat st;
+  struct vc_gdm70x_record rec;
+  struct vc_gdm70x_tslog* log_p = 0;
+  struct timespec t0 = {0, 0};
+  struct point p;
+  unsigned char buf[VC_GDM70X_RECORD_SIZE];
+  const char* p_output = "-";
+  const char* p_channels = "12";
+  const char* sep;
+  long long index = 0;
+  int c, n, type = PLOT_SVG, retval = 0;
+  char* end;
+  FILE* fp = 0;
+  FILE* out;
+
+  memset(ch,0,sizeof(ch));
+  memset(&f,0,sizeof(f));
+  f.width = 800;
+  f.height = 300;
+
+  while( (c=getopt_long(argc,argv,":n:c:o:s:vhV",longopts,NULL)) != -1 )
+    {
+      switch(c) {
+      case 'n':
+	target = atol(optarg);
+	if(target < 3) {
+	  fprintf(stderr,"vc-gdm70x-plot: points musst be at least 3.\n");
+	  retval = -1;
+	}
+	break;
+      case 'c':
+	p_channels = optarg;
+	if(strspn(optarg,"12") != strlen(optarg) || !*optarg) {
+	  fprintf(stderr,"vc-gdm70x-plot: invalid channels '%s'.\n",optarg);
+	  retval = -1;
+	}
+	break;
+      case 'o':
+	sep = strchr(optarg,':');
+	if(sep && (sep - optarg == 3) && !strncmp(optarg,"svg",3))
+	  type = PLOT_SVG;
+	else if(sep && (sep - optarg == 3) && !strncmp(optarg,"pbm",3))
+	  type = PLOT_PBM;
+	else {
+	  fprintf(stderr,"vc-gdm70x-plot: invalid output '%s'.\n",optarg);
+	  retval = -1;
+	}
+	if(sep)
+	  p_output = sep + 1;
+	break;
+      case 's':
+	f.width = strtol(optarg,&end,10);
+	if(*end == 'x')
+	  f.height = strtol(end + 1,&end,10);
+	if(*end || f.width < 64 || f.height < 32 || f.width > 16384 || f.height > 16384) {
+	  fprintf(stderr,"vc-gdm70x-plot: invalid size '%s'.\n",optarg);
+	  retval = -1;
+	}
+	break;
+      case 'v':
+	++verbose;++vc_gdm70x_verbose;
+	break;
+      case ':':
+	fprintf(stderr,"vc-gdm70x-plot: option '-%c' requires an argument.\n",optopt);
+	retval = -1;
+	break;
+      case 'V':
+	printf("vc-gdm70x-plot %s\n",VC_GDM70X_VERSION);
+	exit(0);
+	break;
+      case 'h':
+	print_help();
+	exit(0);
+      case '?':
+      default:
+	fprintf(stderr,"vc-gdm70x-plot: unknown option '-%c'.\n",optopt);
+	retval = -1;
+	break;
+      }
+    }
+
+  if(optind != argc - 1) {
+    fprintf(stderr,"vc-gdm70x-plot: exactly one file expected.\n");
+    retval = -1;
+  }
+
+  if(retval != 0)
+    {
+      fprintf(stderr,"vc-gdm70x-plot: errors encountered, exiting.\n");
+      exit(-1);
+    }
+
+  /* the number of records is needed in advance */
+  fp = fopen(argv[optind],"rb");
+  if(!fp || fstat(fileno(fp),&st)) {
+    perror("vc-gdm70x-plot: open failed");
+    exit(-1);
+  }
+
+  if(fread(buf,1,VC_GDM70X_RECORD_HEADER,fp) != VC_GDM70X_RECORD_HEADER) {
+    fprintf(stderr,"vc-gdm70x-plot: '%s' is too short.\n",argv[optind]);
+    exit(-1);
+  }
+
+  if(!memcmp(buf,VC_GDM70X_TSLOG_MAGIC,8)) {
+    fclose(fp);
+    fp = 0;
+    log_p = vc_gdm70x_tslog_open(argv[optind],VC_GDM70X_TSLOG_READ);
+    if(!log_p) {
+      fprintf(stderr,"vc-gdm70x-plot: vc_gdm70x_tslog_open failed.\n");
+      exit(-1);
+    }
+    total = vc_gdm70x_tslog_count(log_p);
+  } else if(!memcmp(buf,"GDM70XR",8) &&
+	    vc_gdm70x_get32(buf + 12) == VC_GDM70X_RECORD_SIZE) {
+    total = (st.st_size - VC_GDM70X_RECORD_HEADER) / VC_GDM70X_RECORD_SIZE;
+  } else {
+    fprintf(stderr,"vc-gdm70x-plot: '%s' is no record file or tslog.\n",argv[optind]);
+    exit(-1);
+  }
+
+  for(c = 0; c < 2; c++) {
+    ch[c].enabled = strchr(p_channels,'1' + c) != 0;
+    ch[c].bucket = -1;
+    ch[c].max_points = target;
+    ch[c].point = ch[c].enabled ? malloc(target * sizeof(struct point)) : 0;
+    if(ch[c].enabled && !ch[c].point) {
+      fprintf(stderr,"vc-gdm70x-plot: malloc failed.\n");
+      exit(-1);
+    }
+  }
+
+  for(index = 0; index < total; index++) {
+    if(log_p) {
+      n = vc_gdm70x_tslog_read(log_p,&rec);
+      if(n < 0)
+	retval = -1;
+      if(n <= 0)
+	break;
+    } else {
+      if(fread(buf,1,VC_GDM70X_RECORD_SIZE,fp) != VC_GDM70X_RECORD_SIZE)
+	break;
+      vc_gdm70x_record_unpack(buf,&rec);
+    }
+
+    if(index == 0)
+      t0 = rec.ts;
+
+    p.x = (rec.ts.tv_sec - t0.tv_sec) + (rec.ts.tv_nsec - t0.tv_nsec) * 1e-9;
+
+    for(c = 0; c < 2; c++) {
+      if(!ch[c].enabled)
+	continue;
+
+      p.y = vc_gdm70x_data_si(c ? &(rec.data2) : &(rec.data1));
+      if(p.y != p.y) /* NAN on overflow */
+	continue;
+
+      if(ch[c].points == 0)
+	ch[c].unit = c ? rec.data2.unit : rec.data1.unit;
+      channel_add(ch + c,index,&p);
+    }
+  }
+
+  if(verbose)
+    fprintf(stderr,"vc-gdm70x-plot: %lld of %lld records read.\n",index,total);
+
+  f.left = f.right = 70;
+  f.top = 10;
+  f.bottom = 20;
+  f.x0 = 0;
+  f.x1 = 0;
+
+  for(c = 0; c < 2; c++) {
+    channel_finish(ch + c);
+    if(ch[c].points && ch[c].last.x > f.x1)
+      f.x1 = ch[c].last.x;
+  }
+
+  if(type == PLOT_PBM)
+    f.left = f.right = f.top = f.bottom = 0;
+
+  if(strcmp(p_output,"-") == 0)
+    out = stdout;
+  else
+    out = fopen(p_output,"wb");
+
+  if(!out) {
+    perror("vc-gdm70x-plot: open failed");
+    exit(-1);
+  }
+
+  if(type == PLOT_SVG)
+    write_svg(out,&f,ch,&t0);
+  else if(write_pbm(out,&f,ch))
+    retval = -1;
+
+  if(fclose(out)) {
+    perror("vc-gdm70x-plot: close failed");
+    retval = -1;
+  }
+
+  if(fp)
+    fclose(fp);
+  vc_gdm70x_tslog_close(log_p);
+  free(ch[0].point);
+  free(ch[1].point);
+
+  return retval ? -1 : 0;
+}
@@ -0,0 +1,100 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_SERVER__
+#define __VC_GDM70X_SERVER__
+
+#include "vc-gdm70x.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The server publishes records and images to any number of clients
+   connected via an unix domain socket or tcp on localhost. Each record is
+   encoded once into a reference counted message, which is queued to all
+   clients. Sockets are never blocking: a client whose queue is full gets
+   disconnected instead of stalling the reader. */
+
+#define VC_GDM70X_SERVER_QUEUE 64
+
+struct vc_gdm70x_message {
+  int refs;
+  size_t size;
+  char data[1];
+};
+
+struct vc_gdm70x_client {
+  int fd;
+  unsigned int head;   /* first queued message */
+  unsigned int count;  /* number of queued messages */
+  size_t offset;       /* bytes of the first message already sent */
+  struct vc_gdm70x_message* queue[VC_GDM70X_SERVER_QUEUE];
+};
+
+struct vc_gdm70x_server {
+  int fd;
+  int type;        /* encoding of records, enum vc_gdm70x_sink_type */
+  char* path;      /* path of the unix domain socket */
+
+  int max_queue;   /* maximum number of messages queued per client */
+  int clients;
+  int max_clients;
+  struct vc_gdm70x_client* client;
+};
+
+/* vc_gdm70x_server_open: listen on "unix:PATH" or "tcp:PORT" (localhost),
+   records are encoded as given by type (see vc-gdm70x-sink.h) */
+extern struct vc_gdm70x_server* vc_gdm70x_server_open(const char* address, int type);
+
+/* vc_gdm70x_server_close: disconnect all clients and stop listening */
+extern void vc_gdm70x_server_close(struct vc_gdm70x_server* srv_p);
+
+/* vc_gdm70x_server_setqueue: set the maximum queue length of the clients */
+extern void vc_gdm70x_server_setqueue(struct vc_gdm70x_server* srv_p, int count);
+
+/* vc_gdm70x_server_publish: send size bytes of data to all clients */
+extern int vc_gdm70x_server_publish(struct vc_gdm70x_server* srv_p,
+				    const void* data, size_t size);
+
+/* vc_gdm70x_server_publish_record: encode and publish a record */
+extern int vc_gdm70x_server_publish_record(struct vc_gdm70x_server* srv_p,
+					   const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_server_publish_image: publish an image as json line, images
+   are published for the json lines encoding only */
+extern int vc_gdm70x_server_publish_image(struct vc_gdm70x_server* srv_p,
+					  const struct timespec* ts,
+					  const unsigned char* image);
+
+/* vc_gdm70x_server_wait: serve clients until fd gets readable or timeout
+   milliseconds have passed, returns 1 if fd is readable, 0 on timeout and
+   -1 on errors */
+extern int vc_gdm70x_server_wait(struct vc_gdm70x_server* srv_p, int fd, int timeout);
+
+/* vc_gdm70x_server_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_server_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_SHM__
+#define __VC_GDM70X_SHM__
+
+#include "vc-gdm70x.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The latest record and image are published in a POSIX shared memory
+   segment. Record and image are each guarded by a sequence counter,
+   which is odd while the writer updates them. Readers copy the data
+   and retry if the counter changed meanwhile, so reading needs neither
+   syscalls nor locks and the writer never waits for readers. */
+
+#define VC_GDM70X_SHM_MAGIC   0x4d445847 /* "GXDM" */
+#define VC_GDM70X_SHM_VERSION 1
+
+/* number of attempts of a reader before giving up */
+#define VC_GDM70X_SHM_RETRIES 10000
+
+struct vc_gdm70x_shm_segment {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int size;         /* size of this struct */
+  int writer;                /* pid of the writer, 0 if it is gone */
+
+  unsigned int seq;          /* odd while the record is written */
+  unsigned long long count;  /* records published so far */
+  struct vc_gdm70x_record rec;
+
+  unsigned int image_seq;    /* odd while the image is written */
+  unsigned long long image_count;
+  struct timespec image_ts;
+  unsigned char image[VC_GDM70X_IMAGE_SIZE];
+};
+
+struct vc_gdm70x_shm {
+  int fd;
+  int writer;
+  struct vc_gdm70x_shm_segment* seg;
+};
+
+/* vc_gdm70x_shm_create: create or reuse the segment name (e.g. "/gdm70x")
+   for publishing */
+extern struct vc_gdm70x_shm* vc_gdm70x_shm_create(const char* name);
+
+/* vc_gdm70x_shm_open: open the segment name for reading */
+extern struct vc_gdm70x_shm* vc_gdm70x_shm_open(const char* name);
+
+/* vc_gdm70x_shm_close: unmap the segment, it is not removed */
+extern void vc_gdm70x_shm_close(struct vc_gdm70x_shm* shm_p);
+
+/* vc_gdm70x_shm_publish: publish a record */
+extern void vc_gdm70x_shm_publish(struct vc_gdm70x_shm* shm_p,
+				  const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_shm_publish_image: publish an image */
+extern void vc_gdm70x_shm_publish_image(struct vc_gdm70x_shm* shm_p,
+					const struct timespec* ts,
+					const unsigned char* image);
+
+/* vc_gdm70x_shm_read: copy the latest record, count (may be NULL) is set
+   to the number of records published so far. Returns -1 if no consistent
+   copy was made, e.g. the writer died while publishing */
+extern int vc_gdm70x_shm_read(const struct vc_gdm70x_shm* shm_p,
+			      struct vc_gdm70x_record* rec_p,
+			      unsigned long long* count);
+
+/* vc_gdm70x_shm_read_image: copy the latest image like vc_gdm70x_shm_read */
+extern int vc_gdm70x_shm_read_image(const struct vc_gdm70x_shm* shm_p,
+				    struct timespec* ts, unsigned char* image,
+				    unsigned long long* count);
+
+/* vc_gdm70x_shm_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_shm_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+/* vc_gdm70x_shm_image_func: image callback for vc_gdm70x_setfunc_image */
+extern int vc_gdm70x_shm_image_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_SINK__
+#define __VC_GDM70X_SINK__
+
+#include "vc-gdm70x.h"
+#include "vc-gdm70x-expr.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A sink encodes records and collects them in memory. The collected data
+   is written with a single writev once flush_size bytes are pending or
+   the oldest pending record is older than flush_interval. Sinks can be
+   chained using the next pointer, vc_gdm70x_sink_func passes each record
+   to all sinks of a chain. The text sinks append the values derived by
+   an optional set of expressions to each record. */
+
+enum vc_gdm70x_sink_type {
+  VC_GDM70X_SINK_CSV    = 0, /* ts;value1;mult1;unit1;value2;mult2;unit2 */
+  VC_GDM70X_SINK_JSONL  = 1, /* one json object per line */
+  VC_GDM70X_SINK_BINARY = 2, /* header and VC_GDM70X_RECORD_SIZE bytes per record */
+};
+
+/* size of a packed record */
+#define VC_GDM70X_RECORD_SIZE 32
+
+/* size of the header of binary record files */
+#define VC_GDM70X_RECORD_HEADER 16
+
+#define VC_GDM70X_SINK_BLOCK  4096
+#define VC_GDM70X_SINK_BLOCKS 16
+
+struct vc_gdm70x_sink {
+  int fd;
+  int close_fd;
+  int type;
+  int error;
+
+  size_t flush_size;   /* bytes */
+  int flush_interval;  /* milliseconds */
+  struct timespec first; /* time the oldest pending record was added */
+
+  int blocks;          /* blocks in use */
+  size_t pending;      /* bytes in all blocks */
+  size_t used[VC_GDM70X_SINK_BLOCKS];
+  char buf[VC_GDM70X_SINK_BLOCKS][VC_GDM70X_SINK_BLOCK];
+
+  const struct vc_gdm70x_expr* expr; /* derived values to append */
+
+  struct vc_gdm70x_sink* next;
+};
+
+/* vc_gdm70x_unit_name: name of a unit as used in the text sinks */
+extern const char* vc_gdm70x_unit_name(enum vc_unit unit);
+
+/* vc_gdm70x_record_pack: pack a record into VC_GDM70X_RECORD_SIZE bytes */
+extern void vc_gdm70x_record_pack(const struct vc_gdm70x_record* rec_p,
+				  unsigned char* buf);
+
+/* vc_gdm70x_record_unpack: unpack a record packed by vc_gdm70x_record_pack */
+extern void vc_gdm70x_record_unpack(const unsigned char* buf,
+				    struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_format_header: write the file header of a sink type into buf,
+   returns the length, -1 if buf is too small */
+extern int vc_gdm70x_format_header(int type, char* buf, size_t size);
+
+/* vc_gdm70x_format_record: encode a record into buf, returns the length,
+   -1 if buf is too small */
+extern int vc_gdm70x_format_record(int type, const struct vc_gdm70x_record* rec_p,
+				   char* buf, size_t size);
+
+/* vc_gdm70x_sink_create: create a sink writing to fd, the file header is
+   written with the first flush */
+extern struct vc_gdm70x_sink* vc_gdm70x_sink_create(int type, int fd);
+
+/* vc_gdm70x_sink_open: create a sink writing to a new file, "-" for stdout */
+extern struct vc_gdm70x_sink* vc_gdm70x_sink_open(int type, const char* filename);
+
+/* vc_gdm70x_sink_close: flush and close a sink and all sinks chained to it */
+extern int vc_gdm70x_sink_close(struct vc_gdm70x_sink* sink_p);
+
+/* vc_gdm70x_sink_setflush: set the flush thresholds */
+extern void vc_gdm70x_sink_setflush(struct vc_gdm70x_sink* sink_p,
+				    size_t size, int interval);
+
+/* vc_gdm70x_sink_setexpr: append the derived values of expr_p to the
+   records of a text sink, must be called before the first write */
+extern int vc_gdm70x_sink_setexpr(struct vc_gdm70x_sink* sink_p,
+				  const struct vc_gdm70x_expr* expr_p);
+
+/* vc_gdm70x_sink_write: add a record to a single sink */
+extern int vc_gdm70x_sink_write(struct vc_gdm70x_sink* sink_p,
+				const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_sink_flush: write all pending data of a single sink */
+extern int vc_gdm70x_sink_flush(struct vc_gdm70x_sink* sink_p);
+
+/* vc_gdm70x_sink_flush_due: flush the sinks of a chain whose oldest
+   pending record is older than their flush interval, to be called
+   regularly while no records arrive */
+extern int vc_gdm70x_sink_flush_due(struct vc_gdm70x_sink* sink_p);
+
+/* vc_gdm70x_sink_func: data callback for vc_gdm70x_setfunc_data passing
+   the record to all sinks chained to ptr */
+extern int vc_gdm70x_sink_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_SPECTRUM__
+#define __VC_GDM70X_SPECTRUM__
+
+#include "vc-gdm70x.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The spectrum of both channels over the last size records is kept up
+   to date by a sliding DFT: each record adds its difference to the
+   record leaving the window to every bin and rotates the bin, which is
+   O(bins) per record. Bins are kept as separate arrays of real and
+   imaginary parts padded to a multiple of VC_GDM70X_SPECTRUM_LANES, so
+   the compiler can vectorize the update. Every VC_GDM70X_SPECTRUM_SYNC
+   windows all bins are computed again from the samples to drop rounding
+   errors. Overflowed values are replaced by the value before. */
+
+#define VC_GDM70X_SPECTRUM_SIZE  256
+#define VC_GDM70X_SPECTRUM_LANES 4
+#define VC_GDM70X_SPECTRUM_SYNC  16
+
+struct vc_gdm70x_spectrum_channel {
+  double* re;            /* bins 1 .. bins */
+  double* im;
+  double* sample;        /* last size values */
+  double last;           /* last valid value */
+
+  /* dominant bin, see vc_gdm70x_spectrum_peak */
+  double freq;           /* Hz */
+  double amplitude;      /* of the sine, in base units */
+};
+
+struct vc_gdm70x_spectrum {
+  int size;              /* records per window */
+  int bins;              /* bins 1 .. size / 2 at most */
+  int stride;            /* bins rounded up to the lanes */
+  int interval;          /* records between two reports */
+  int pos;               /* oldest sample */
+  unsigned long count;   /* records so far */
+
+  double* cos_n;         /* cos(2 pi n / size) */
+  double* sin_n;
+  double* time;          /* times of the samples, s since t0 */
+  struct timespec t0;
+  double rate;           /* estimated records per second */
+
+  struct vc_gdm70x_spectrum_channel ch[2];
+
+  int (* func_report) (struct vc_gdm70x_spectrum* spec_p,
+		       const struct vc_gdm70x_record* rec_p, void* ptr);
+  void* func_report_ext;
+};
+
+/* vc_gdm70x_spectrum_create: create an analysis of the last size (>= 8)
+   records with bins bins, 0 for all up to half the record rate */
+extern struct vc_gdm70x_spectrum* vc_gdm70x_spectrum_create(int size, int bins);
+
+/* vc_gdm70x_spectrum_destroy: destroy an analysis */
+extern void vc_gdm70x_spectrum_destroy(struct vc_gdm70x_spectrum* spec_p);
+
+/* vc_gdm70x_spectrum_reset: forget all records, e.g. after reopening */
+extern void vc_gdm70x_spectrum_reset(struct vc_gdm70x_spectrum* spec_p);
+
+/* vc_gdm70x_spectrum_setinterval: report every count records once the
+   window is filled, defaults to size */
+extern void vc_gdm70x_spectrum_setinterval(struct vc_gdm70x_spectrum* spec_p,
+					   int count);
+
+/* vc_gdm70x_spectrum_setfunc_report: set the callback for reports, the
+   peaks are updated before it is called */
+extern void vc_gdm70x_spectrum_setfunc_report(struct vc_gdm70x_spectrum* spec_p,
+					      int (*func) (struct vc_gdm70x_spectrum* spec_p,
+							   const struct vc_gdm70x_record* rec_p,
+							   void* ptr),
+					      void* ptr);
+
+/* vc_gdm70x_spectrum_update: add a record, returns the result of the
+   report callback or 0 */
+extern int vc_gdm70x_spectrum_update(struct vc_gdm70x_spectrum* spec_p,
+				     const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_spectrum_peak: find the dominant bin of channel 1 or 2 and
+   store its frequency and amplitude in the channel, returns the bin or
+   -1 if the window is not filled yet */
+extern int vc_gdm70x_spectrum_peak(struct vc_gdm70x_spectrum* spec_p, int channel);
+
+/* vc_gdm70x_spectrum_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_spectrum_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
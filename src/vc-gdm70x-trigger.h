@@ -0,0 +1,134 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_TRIGGER__
+#define __VC_GDM70X_TRIGGER__
+
+#include "vc-gdm70x.h"
+#include "vc-gdm70x-sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A trigger keeps the last pre records in a ring. When its condition
+   fires, these records, the triggering record and the following post
+   records are passed to the record callback. Level and window conditions
+   keep the capture going as long as they hold, edge conditions restart
+   the post count on every crossing. Values are compared in SI units. */
+
+enum vc_gdm70x_trigger_type {
+  VC_GDM70X_TRIGGER_BELOW   = 0, /* value <  level */
+  VC_GDM70X_TRIGGER_ABOVE   = 1, /* value >  level */
+  VC_GDM70X_TRIGGER_RISING  = 2, /* value crosses level upwards */
+  VC_GDM70X_TRIGGER_FALLING = 3, /* value crosses level downwards */
+  VC_GDM70X_TRIGGER_INSIDE  = 4, /* level <= value <= high */
+  VC_GDM70X_TRIGGER_OUTSIDE = 5, /* value < level or value > high */
+};
+
+struct vc_gdm70x_trigger {
+  int channel;       /* 1 or 2 */
+  int type;
+  double level;
+  double high;       /* upper level of window conditions */
+
+  int pre;           /* size of the ring */
+  int post;
+  int head;          /* oldest record in the ring */
+  int count;         /* records in the ring */
+  struct vc_gdm70x_record* ring;
+
+  int capturing;
+  int remaining;     /* post records still to pass */
+  int last_valid;
+  double last;       /* value of the previous record, for edges */
+  unsigned long triggers;
+
+  int image_valid;
+  struct timespec image_ts;
+  unsigned char image[VC_GDM70X_IMAGE_SIZE]; /* last image */
+
+  int (* func_record) (const struct vc_gdm70x_record* rec_p, void* ptr);
+  int (* func_fire) (struct vc_gdm70x_trigger* trig_p,
+		     const struct vc_gdm70x_record* rec_p, void* ptr);
+
+  void* func_record_ext;
+  void* func_fire_ext;
+};
+
+/* vc_gdm70x_trigger_create: create a trigger passing pre records before
+   and post records after the triggering one */
+extern struct vc_gdm70x_trigger* vc_gdm70x_trigger_create(int pre, int post);
+
+/* vc_gdm70x_trigger_destroy: destroy a trigger */
+extern void vc_gdm70x_trigger_destroy(struct vc_gdm70x_trigger* trig_p);
+
+/* vc_gdm70x_trigger_setcondition: set channel, type and levels in SI units,
+   high is used by window conditions only */
+extern int vc_gdm70x_trigger_setcondition(struct vc_gdm70x_trigger* trig_p,
+					  int channel, int type,
+					  double level, double high);
+
+/* vc_gdm70x_trigger_parse: set the condition from a string "D<channel>"
+   followed by '<' (below), '>' (above), '/' (rising), '\' (falling),
+   '=' (inside) or '!' (outside) and the level, window conditions take
+   "LOW:HIGH". Levels may end with a multiplier n, u, m, k or M */
+extern int vc_gdm70x_trigger_parse(struct vc_gdm70x_trigger* trig_p,
+				   const char* spec);
+
+/* vc_gdm70x_trigger_setfunc_record: set the function receiving the
+   captured records */
+extern void vc_gdm70x_trigger_setfunc_record(struct vc_gdm70x_trigger* trig_p,
+					     int (*func) (const struct vc_gdm70x_record* rec_p,
+							  void* ptr),
+					     void* ptr);
+
+/* vc_gdm70x_trigger_setfunc_fire: set the function called when the
+   condition fires, before the pre records are passed */
+extern void vc_gdm70x_trigger_setfunc_fire(struct vc_gdm70x_trigger* trig_p,
+					   int (*func) (struct vc_gdm70x_trigger* trig_p,
+							const struct vc_gdm70x_record* rec_p,
+							void* ptr),
+					   void* ptr);
+
+/* vc_gdm70x_trigger_setsink: pass the captured records to a sink chain */
+extern void vc_gdm70x_trigger_setsink(struct vc_gdm70x_trigger* trig_p,
+				      struct vc_gdm70x_sink* sink_p);
+
+/* vc_gdm70x_trigger_record: feed a record, returns -1 if a callback failed */
+extern int vc_gdm70x_trigger_record(struct vc_gdm70x_trigger* trig_p,
+				    const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_trigger_image: remember an image, which is available in the
+   fire callback */
+extern void vc_gdm70x_trigger_image(struct vc_gdm70x_trigger* trig_p,
+				    const struct timespec* ts,
+				    const unsigned char* image);
+
+/* vc_gdm70x_trigger_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_trigger_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+/* vc_gdm70x_trigger_image_func: image callback for vc_gdm70x_setfunc_image */
+extern int vc_gdm70x_trigger_image_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
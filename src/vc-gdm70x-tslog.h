@@ -0,0 +1,142 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_TSLOG__
+#define __VC_GDM70X_TSLOG__
+
+#include "vc-gdm70x.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A tslog stores records compressed in independent blocks. Each block
+   starts with a header holding the number of records, the size and the
+   time of its first and last record, so readers skip blocks without
+   decoding them. The header is followed by the runs of equal unit and
+   multiplier descriptors and a bit stream holding per record the delta
+   of delta of the timestamp and the xor of each value with the value
+   before, packed as described in "Gorilla: A Fast, Scalable, In-Memory
+   Time Series Database" (Pelkonen et al., 2015). */
+
+#define VC_GDM70X_TSLOG_MAGIC  "GDM70XG"
+
+#define VC_GDM70X_TSLOG_HEADER 16  /* file header */
+#define VC_GDM70X_TSLOG_BLOCK  32  /* block header */
+#define VC_GDM70X_TSLOG_RUN    8   /* descriptor run */
+
+/* default number of records per block */
+#define VC_GDM70X_TSLOG_RECORDS 1024
+
+enum vc_gdm70x_tslog_mode {
+  VC_GDM70X_TSLOG_READ   = 0,
+  VC_GDM70X_TSLOG_APPEND = 1,
+};
+
+struct vc_gdm70x_tslog_run {
+  unsigned long count;
+  unsigned char unit1, mult1, unit2, mult2;
+};
+
+struct vc_gdm70x_tslog_channel {
+  unsigned int value;    /* bits of the last value */
+  int lead, trail;       /* zero bits around the last xor */
+};
+
+struct vc_gdm70x_tslog {
+  int fd;
+  int mode;
+  int block_records;     /* records per block */
+  int flush_interval;    /* milliseconds, < 0 for full blocks only */
+  struct timespec started; /* time the current block was started */
+
+  /* records of the current block */
+  unsigned long count;
+  long long first, last; /* times in ns */
+  long long delta;
+  struct vc_gdm70x_tslog_channel ch[2];
+
+  struct vc_gdm70x_tslog_run* run;
+  unsigned long runs, runs_alloc;
+
+  unsigned char* bits;   /* bit stream */
+  size_t bits_len, bits_alloc;
+  unsigned long long acc; /* bits not yet in the stream */
+  int acc_bits;
+  size_t pos;            /* read position in bits */
+
+  unsigned long long offset; /* offset of the next block read or written */
+
+  /* reader state */
+  unsigned long index;   /* record within the current block */
+  unsigned long run_index, run_left;
+  struct vc_gdm70x_record pending; /* record found by seek */
+  int pending_valid;
+};
+
+/* vc_gdm70x_tslog_open: open a tslog for reading or appending, a block
+   cut off when the writer died is removed when appending */
+extern struct vc_gdm70x_tslog* vc_gdm70x_tslog_open(const char* filename, int mode);
+
+/* vc_gdm70x_tslog_close: close the tslog, writing the pending block */
+extern int vc_gdm70x_tslog_close(struct vc_gdm70x_tslog* log_p);
+
+/* vc_gdm70x_tslog_setblock: set the number of records per block */
+extern void vc_gdm70x_tslog_setblock(struct vc_gdm70x_tslog* log_p, int count);
+
+/* vc_gdm70x_tslog_setflush: also write a block once its first record is
+   older than interval milliseconds, a negative interval disables this */
+extern void vc_gdm70x_tslog_setflush(struct vc_gdm70x_tslog* log_p, int interval);
+
+/* vc_gdm70x_tslog_write: append a record */
+extern int vc_gdm70x_tslog_write(struct vc_gdm70x_tslog* log_p,
+				 const struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_tslog_flush: write the pending records as a block */
+extern int vc_gdm70x_tslog_flush(struct vc_gdm70x_tslog* log_p);
+
+/* vc_gdm70x_tslog_flush_due: write the pending records if they are older
+   than the flush interval, to be called regularly while no records
+   arrive */
+extern int vc_gdm70x_tslog_flush_due(struct vc_gdm70x_tslog* log_p);
+
+/* vc_gdm70x_tslog_read: read the next record, returns 1 on success, 0 at
+   the end of the log and -1 on errors */
+extern int vc_gdm70x_tslog_read(struct vc_gdm70x_tslog* log_p,
+				struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_tslog_seek: position before the first record at or after ts,
+   decoding only the block containing it */
+extern int vc_gdm70x_tslog_seek(struct vc_gdm70x_tslog* log_p,
+				const struct timespec* ts);
+
+/* vc_gdm70x_tslog_count: number of records, read from the block headers,
+   -1 on errors */
+extern long long vc_gdm70x_tslog_count(struct vc_gdm70x_tslog* log_p);
+
+/* vc_gdm70x_tslog_func: data callback for vc_gdm70x_setfunc_data */
+extern int vc_gdm70x_tslog_func(struct vc_gdm70x* gdm_p, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,13 +19,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "../config.h"
 #include "vc-gdm70x.h"
+#include "vc-gdm70x-archive.h"
+#include "vc-gdm70x-sink.h"
+#include "vc-gdm70x-server.h"
+#include "vc-gdm70x-trigger.h"
+#include "vc-gdm70x-capture.h"
+#include "vc-gdm70x-shm.h"
+#include "vc-gdm70x-clock.h"
+#include "vc-gdm70x-tslog.h"
+#include "vc-gdm70x-expr.h"
+#include "vc-gdm70x-spectrum.h"
 #include <stdio.h>
+#include <signal.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <assert.h>
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 const struct option longopts [] = {
   { "device", required_argument, 0, 'd' },
@@ -33,6 +52,29 @@ const struct option longopts [] = {
   { "format", required_argument,0,'f'},
   { "filename-format", required_argument,0,'F'},
   { "enable-image", no_argument,0,'i'},
+  { "image-changed", no_argument,0,'u'},
+  { "image-delta", required_argument,0,'k'},
+  { "delta-format", required_argument,0,'K'},
+  { "archive", required_argument,0,'a'},
+  { "max-backoff", required_argument,0,'B'},
+  { "output", required_argument,0,'o'},
+  { "flush-size", required_argument,0,'S'},
+  { "flush-interval", required_argument,0,'I'},
+  { "serve", required_argument,0,'L'},
+  { "serve-format", required_argument,0,'R'},
+  { "serve-queue", required_argument,0,'Q'},
+  { "trigger", required_argument,0,'T'},
+  { "pre", required_argument,0,'P'},
+  { "post", required_argument,0,'O'},
+  { "tap", required_argument,0,'W'},
+  { "replay", required_argument,0,'Y'},
+  { "replay-paced", no_argument,0,'y'},
+  { "shm", required_argument,0,'M'},
+  { "dejitter", optional_argument,0,'J'},
+  { "derive", required_argument,0,'E'},
+  { "calib", required_argument,0,'C'},
+  { "spectrum", optional_argument,0,'N'},
+  { "spectrum-interval", required_argument,0,'Z'},
   { "count",required_argument,0,'c'},
   { "version",no_argument,0,'V'},
   { "help",no_argument,0,'h'},
@@ -42,12 +84,217 @@ const struct option longopts [] = {
 const char default_device[] = "/dev/ttyS0";
 const char default_print[] = "TIME: %S DATA1: %D1 %M1%U1 %T1; DATA2: %D2 %M2%U2 %T2\n";
 const char default_file[] = "GDM70X-%Y%M%D-%h%m-%N.xpm";
+const char default_delta[] = "GDM70X-%Y%M%D-%h%m-%N.gdd";
 
 static int verbose = 0;
 static int record_count = 0;
 
 static struct timespec ts_start;
 
+static const char* p_delta = default_delta;
+static int image_delta_interval = 0;
+static int image_delta_count = 0;
+static unsigned char image_key[VC_GDM70X_IMAGE_SIZE];
+static char image_keyname[512];
+
+static struct vc_gdm70x_archive* archive_p = 0;
+
+static volatile sig_atomic_t running = 1;
+
+static int max_backoff = 30000; /* ms */
+
+#define MAX_OUTPUTS 8
+
+static struct vc_gdm70x_sink* sinks = 0;
+static struct vc_gdm70x_server* server_p = 0;
+static struct vc_gdm70x_trigger* trigger_p = 0;
+static struct vc_gdm70x_shm* shm_p = 0;
+static struct vc_gdm70x_clock* clock_p = 0;
+static struct vc_gdm70x_tslog* tslog_p = 0;
+static struct vc_gdm70x_expr* expr_p = 0;
+static struct vc_gdm70x_spectrum* spectrum_p = 0;
+static struct timespec ts_raw;   /* arrival time of the last record */
+static long records_lost = 0;    /* records lost before the last one */
+static void* image_ptr = 0;
+
+static int (* store_image) (struct vc_gdm70x* gdm_p, void* ptr) = 0;
+
+void stop_handler(int sig)
+{
+  (void) sig;
+  running = 0;
+}
+
+double seconds_since_start(const struct timespec* ts)
+{
+  return (double) (ts->tv_sec  - ts_start.tv_sec) + 
+         (double) (ts->tv_nsec - ts_start.tv_nsec) * 1e-9;
+}
+
+void backoff_sleep(int ms)
+{
+  struct timespec ts;
+
+  ts.tv_sec  = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+
+  nanosleep(&ts,NULL);
+}
+
+/* wait_device: wait up to ms milliseconds for a change within the directory
+   of the device, returns 1 if something happened there */
+int wait_device(int watch_fd, int ms)
+{
+#if defined(HAVE_POLL_H) && defined(HAVE_SYS_INOTIFY_H)
+  struct pollfd pfd;
+  char buf[4096];
+
+  if(watch_fd >= 0) {
+    pfd.fd = watch_fd;
+    pfd.events = POLLIN;
+
+    if(poll(&pfd,1,ms) > 0) {
+      while(read(watch_fd,buf,sizeof(buf)) > 0);
+      return 1;
+    }
+
+    return 0;
+  }
+#endif
+
+  backoff_sleep(ms);
+  return 0;
+}
+
+/* wait_meter: wait up to ms milliseconds for data of the meter, returns
+   0 on timeout */
+int wait_meter(int fd, int ms)
+{
+#ifdef HAVE_POLL_H
+  struct pollfd pfd;
+  int n;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  n = poll(&pfd,1,ms);
+  if(n == 0 || (n < 0 && errno == EINTR))
+    return 0;
+#endif
+
+  return 1;
+}
+
+/* flush_outputs: write the pending records of all outputs, or of those
+   waiting longer than their flush interval */
+void flush_outputs(int all)
+{
+  struct vc_gdm70x_sink* sink_p;
+
+  if(!all) {
+    vc_gdm70x_sink_flush_due(sinks);
+    if(tslog_p)
+      vc_gdm70x_tslog_flush_due(tslog_p);
+    return;
+  }
+
+  for(sink_p = sinks; sink_p; sink_p = sink_p->next)
+    vc_gdm70x_sink_flush(sink_p);
+
+  if(tslog_p)
+    vc_gdm70x_tslog_flush(tslog_p);
+}
+
+/* on_idle: flush the outputs while the meter stalls within a frame */
+int on_idle(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  (void) gdm_p;
+  (void) ptr;
+
+  flush_outputs(0);
+
+  return running ? 0 : -1;
+}
+
+/* reconnect: reopen the device after it has gone, retrying with
+   exponential backoff or as soon as the device node reappears */
+int reconnect(struct vc_gdm70x* gdm_p, const char* device)
+{
+  struct timespec ts_lost, ts_back;
+  int watch_fd = -1;
+  int delay = 100;
+  int saved_verbose = vc_gdm70x_verbose;
+
+  clock_gettime(CLOCK_REALTIME,&ts_lost);
+
+  fputs("vc-gdm70x: device lost, trying to reconnect.\n",stderr);
+
+  /* failing calls are expected, keep the library quiet */
+  if(!verbose)
+    vc_gdm70x_verbose = 0;
+
+  if(gdm_p->fd >= 0)
+    vc_gdm70x_close(gdm_p);
+
+#ifdef HAVE_SYS_INOTIFY_H
+  {
+    char dir[512];
+
+    strncpy(dir,device,sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if( (watch_fd >= 0) &&
+	(inotify_add_watch(watch_fd,dirname(dir),IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0)) {
+      if(verbose)
+	perror("vc-gdm70x: inotify_add_watch failed");
+      close(watch_fd);
+      watch_fd = -1;
+    }
+  }
+#endif
+
+  while(running) {
+    if(vc_gdm70x_open(gdm_p,device) == 0) {
+      if(vc_gdm70x_sync(gdm_p) == 0)
+	break;
+      vc_gdm70x_close(gdm_p);
+    }
+
+    if(verbose)
+      fprintf(stderr,"vc-gdm70x: reconnect failed, next try in %i ms.\n",delay);
+
+    if(!wait_device(watch_fd,delay))
+      delay = (delay * 2 < max_backoff) ? delay * 2 : max_backoff;
+  }
+
+  vc_gdm70x_verbose = saved_verbose;
+
+  if(watch_fd >= 0)
+    close(watch_fd);
+
+  if(!running)
+    return -1;
+
+  clock_gettime(CLOCK_REALTIME,&ts_back);
+
+  /* the records before the outage say nothing about the meter's clock */
+  if(clock_p)
+    vc_gdm70x_clock_reset(clock_p);
+
+  /* neither does the spectrum, its window would span the gap */
+  if(spectrum_p)
+    vc_gdm70x_spectrum_reset(spectrum_p);
+
+  fputs("vc-gdm70x: reconnected.\n",stderr);
+  fprintf(stdout,"# outage from %.3lf to %.3lf (%.3lf s)\n",
+	  seconds_since_start(&ts_lost), seconds_since_start(&ts_back),
+	  seconds_since_start(&ts_back) - seconds_since_start(&ts_lost));
+  fflush(stdout);
+
+  return 0;
+}
+
 int format_filename(char* filename, const char* format_string, const int count)
 {
   int i=0,c;
@@ -97,7 +344,8 @@ int format_filename(char* filename, const char* format_string, const int count)
 
 int print_values(struct vc_gdm70x* gdm_p, void* ptr) 
 {
-  int c;
+  int c, n;
+  const char* end;
   struct vc_gdm70x_data *data_p;
   assert(gdm_p);
 
@@ -167,9 +415,24 @@ int print_values(struct vc_gdm70x* gdm_p, void* ptr)
 	    case 'C': fprintf(stdout,"%.3lf", (double) gdm_p->ts.tv_sec + 
 	                                      (double) gdm_p->ts.tv_nsec * 1e-9);
 		break;
-	    case 'S': fprintf(stdout,"%.3lf", (double) (gdm_p->ts.tv_sec  - ts_start.tv_sec) + 
-	                                      (double) (gdm_p->ts.tv_nsec - ts_start.tv_nsec) * 1e-9);
+	    case 'S': fprintf(stdout,"%.3lf", seconds_since_start(&(gdm_p->ts)));
 		break;
+	    case 'R': fprintf(stdout,"%.3lf", (double) ts_raw.tv_sec + 
+	                                      (double) ts_raw.tv_nsec * 1e-9);
+		break;
+	    case 'K': fprintf(stdout,"%lli", clock_p ? clock_p->index : -1LL);
+		break;
+	    case 'G': fprintf(stdout,"%li", records_lost); break;
+	    case '{':
+	      end = strchr((char*)ptr,'}');
+	      n = (end && expr_p) ? vc_gdm70x_expr_find(expr_p,ptr,end - (char*)ptr) : -1;
+	      if(n < 0) {
+		fputs("vc-gdm70x: unknown name in formatstring.\n",stderr);
+		return -1;
+	      }
+	      fprintf(stdout,"%g",expr_p->value[n]);
+	      ptr = (void*) (end + 1);
+	      break;
 	    case '%': fputc('%',stdout); break;
 	    default:
 	      fputs("vc-gdm70x: error in formatstring.\n",stderr);
@@ -194,21 +457,168 @@ int print_values(struct vc_gdm70x* gdm_p, void* ptr)
   return 0;
 }
 
-int write_xpm(struct vc_gdm70x* gdm_p, void* ptr) {
+int output_record(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  if(ptr && print_values(gdm_p,ptr))
+    return -1;
+
+  if(server_p && vc_gdm70x_server_func(gdm_p,server_p))
+    return -1;
+
+  if(tslog_p && vc_gdm70x_tslog_func(gdm_p,tslog_p))
+    return -1;
+
+  if(sinks)
+    return vc_gdm70x_sink_func(gdm_p,sinks);
+
+  return 0;
+}
+
+int on_data(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  ts_raw = gdm_p->ts;
+
+  if(clock_p) {
+    records_lost = vc_gdm70x_clock_update(clock_p,&(gdm_p->ts));
+    gdm_p->ts = clock_p->ts;
+  }
+
+  /* calibrate once, so every consumer sees the same values */
+  if(expr_p)
+    vc_gdm70x_expr_func(gdm_p,expr_p);
+
+  if(shm_p)
+    vc_gdm70x_shm_func(gdm_p,shm_p);
+
+  if(spectrum_p && vc_gdm70x_spectrum_func(gdm_p,spectrum_p))
+    return -1;
+
+  if(trigger_p)
+    return vc_gdm70x_trigger_func(gdm_p,trigger_p);
+
+  return output_record(gdm_p,ptr);
+}
+
+/* on_trigger_record: output a record captured by the trigger */
+int on_trigger_record(const struct vc_gdm70x_record* rec_p, void* ptr)
+{
+  struct vc_gdm70x out;
+
+  vc_gdm70x_init(&out);
+  out.ts    = rec_p->ts;
+  out.data1 = rec_p->data1;
+  out.data2 = rec_p->data2;
+
+  /* the record is calibrated already, only derive the values again */
+  if(expr_p)
+    vc_gdm70x_expr_derive(expr_p,rec_p);
+
+  return output_record(&out,ptr);
+}
+
+/* on_spectrum: print the dominant frequency and amplitude of both
+   channels */
+int on_spectrum(struct vc_gdm70x_spectrum* spec_p,
+		const struct vc_gdm70x_record* rec_p, void* ptr)
+{
+  if(!ptr)
+    return 0;
+
+  fprintf(stdout,"# spectrum at %.3lf D1 %g Hz %g D2 %g Hz %g\n",
+	  seconds_since_start(&(rec_p->ts)),
+	  spec_p->ch[0].freq,spec_p->ch[0].amplitude,
+	  spec_p->ch[1].freq,spec_p->ch[1].amplitude);
+  fflush(stdout);
+
+  return 0;
+}
+
+/* on_trigger_fire: mark the capture in the output and save the image
+   shown at that time */
+int on_trigger_fire(struct vc_gdm70x_trigger* trig_p,
+		    const struct vc_gdm70x_record* rec_p, void* ptr)
+{
+  struct vc_gdm70x out;
+
+  if(ptr) {
+    fprintf(stdout,"# trigger %lu at %.3lf\n",trig_p->triggers,
+	    seconds_since_start(&(rec_p->ts)));
+    fflush(stdout);
+  }
+
+  if(store_image && trig_p->image_valid) {
+    vc_gdm70x_init(&out);
+    out.ts    = trig_p->image_ts;
+    out.image = trig_p->image;
+    trig_p->image_valid = 0;
+
+    return store_image(&out,image_ptr);
+  }
+
+  return 0;
+}
+
+int on_image(struct vc_gdm70x* gdm_p, void* ptr)
+{
+  /* with a trigger, only the image shown when it fires is saved */
+  if(trigger_p)
+    vc_gdm70x_trigger_image_func(gdm_p,trigger_p);
+  else if(store_image && store_image(gdm_p,ptr))
+    return -1;
+
+  if(shm_p)
+    vc_gdm70x_shm_image_func(gdm_p,shm_p);
+
+  if(server_p)
+    return vc_gdm70x_server_publish_image(server_p,&(gdm_p->ts),gdm_p->image);
+
+  return 0;
+}
+
+/* sink_type: parse the name of an output type */
+int sink_type(const char* name, size_t len)
+{
+  static const struct { const char* name; int type; } types[] = {
+    { "csv",   VC_GDM70X_SINK_CSV },
+    { "jsonl", VC_GDM70X_SINK_JSONL },
+    { "bin",   VC_GDM70X_SINK_BINARY },
+  };
+  size_t i;
+
+  for(i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    if( (strlen(types[i].name) == len) && (strncmp(name,types[i].name,len) == 0))
+      return types[i].type;
+
+  return -1;
+}
+
+/* open_sink: open a sink given as TYPE:FILE */
+struct vc_gdm70x_sink* open_sink(const char* spec)
+{
+  const char* sep = strchr(spec,':');
+  int type;
+
+  if(sep && (type = sink_type(spec,sep - spec)) >= 0)
+    return vc_gdm70x_sink_open(type, sep + 1);
+
+  fprintf(stderr,"vc-gdm70x: invalid output '%s'.\n",spec);
+  return 0;
+}
+
+int find_filename(char* filename, const char* format_string)
+{
   FILE * fp;
-  int i;
   unsigned int n=0;
-  char filename[512];
 
-  assert(gdm_p);
-  assert(ptr);
+  assert(filename);
+  assert(format_string);
 
   if(verbose > 1)
-    fputs("vc-gdm70x: write_xpm: creating filename.\n",stderr);
+    fputs("vc-gdm70x: find_filename: creating filename.\n",stderr);
 
   do
     {
-      format_filename(filename,(char*) ptr,n++);
+      format_filename(filename,format_string,n++);
       fp = fopen(filename,"r");
     }
   while(fp && n < 10000);
@@ -218,36 +628,82 @@ int write_xpm(struct vc_gdm70x* gdm_p, void* ptr) {
 
   if(n >= 10000)
     {
-      fputs("vc-gdm70x: write_xpm: count overflow. Try removing some files.\n",stderr);
+      fputs("vc-gdm70x: find_filename: count overflow. Try removing some files.\n",stderr);
       return -1;
     }
 
   if(verbose)
     {
-      fputs("vc-gdm70x: write_xpm: filename:'",stderr);
+      fputs("vc-gdm70x: find_filename: filename:'",stderr);
       fputs(filename,stderr);
       fputs("'.\n",stderr);
     }
 
+  return 0;
+}
+
+int write_xpm(struct vc_gdm70x* gdm_p, void* ptr) {
+  FILE * fp;
+  char filename[512];
+
+  assert(gdm_p);
+  assert(ptr);
+
+  if(find_filename(filename,(char*) ptr))
+    return -1;
 
   fp = fopen(filename,"w");
 
   if(fp) {
-    fputs("/* XPM */\nstatic char* gdm70x[] = {\n \"128 64 2 1\",\n\"  c white\",\n\"O c black\"",fp);
-    for(i = 0; i< 1024 * 8; i++) {
-      if( (i%128) == 0)
-	fputs(",\n\"",fp);
-      if( gdm_p->image[i/8] & (0x80 >> (i%8)))
-	fputc('O',fp);
-      else
-	fputc(' ',fp);
-      
-      if((i % 128) == 127)
-	fputc('"',fp);
-    }
-    fputs("\n};",fp);
+    vc_gdm70x_image_write_xpm(fp,gdm_p->image);
+    fclose(fp);
+  }
+
+  /* remember the file as keyframe for following deltas */
+  strcpy(image_keyname,filename);
+  memcpy(image_key,gdm_p->image,VC_GDM70X_IMAGE_SIZE);
+  image_delta_count = 0;
+
+  return 0;
+}
+
+int write_delta(struct vc_gdm70x* gdm_p, void* ptr) {
+  FILE * fp;
+  int size;
+  unsigned char delta[VC_GDM70X_DELTA_MAX];
+  char filename[512];
+
+  assert(gdm_p);
+  assert(ptr);
+
+  if(image_delta_interval <= 0 || image_keyname[0] == 0 ||
+     image_delta_count >= image_delta_interval)
+    return write_xpm(gdm_p,ptr);
+
+  if(find_filename(filename,p_delta))
+    return -1;
+
+  size = vc_gdm70x_image_delta(image_key,gdm_p->image,delta);
+
+  fp = fopen(filename,"w");
+
+  if(fp) {
+    fprintf(fp,"GDM70X-DELTA 1\n%s\n",image_keyname);
+    fwrite(delta,1,size,fp);
     fclose(fp);
   }
+
+  image_delta_count++;
+
+  return 0;
+}
+
+int write_archive(struct vc_gdm70x* gdm_p, void* ptr) {
+  assert(gdm_p);
+  assert(ptr);
+
+  return vc_gdm70x_archive_append((struct vc_gdm70x_archive*) ptr,
+				  &(gdm_p->ts), gdm_p->image);
 }
 
 
@@ -260,11 +716,60 @@ void print_help()
   puts("  -d, --device=DEVICE          RS232 device to which the GDM is connected"); 
   printf("                               [%s]\n", default_device);
   puts("  -i, --enable-image           enables receiving of images");
+  puts("  -u, --image-changed          only save images differing from the last one");
+  puts("  -k, --image-delta=COUNT      save up to COUNT images as delta against the");
+  puts("                               last xpm image (keyframe) [0 (disabled)]");
+  puts("      --delta-format=FORMAT    format of the filename of the image deltas");
+  printf("                               [%s]\n", default_delta);
+  puts("  -a, --archive=FILE           append images to the archive FILE instead of");
+  puts("                               creating a file per image, see");
+  puts("                               vc-gdm70x-extract");
   puts("  -c, --count=COUNT            number of records to fetch [0 (infinity)]");
   puts("      --filename-format=FORMAT format of the filename of the images");
   printf("                               [%s]\n", default_file);
   puts("  -f, --format=FORMAT          format of the output of the measured values");
   printf("                               [%*.*s\\n]\n", 0 ,strlen(default_print) - 1, default_print);
+  puts("      --max-backoff=SECONDS    maximum delay between two attempts to reopen");
+  puts("                               a lost device [30]");
+  puts("  -o, --output=TYPE:FILE       write the records to FILE ('-' for stdout)");
+  puts("                               as TYPE 'csv', 'jsonl', 'bin' or 'tslog'");
+  puts("                               (compressed, appended). May be given");
+  puts("                               several times. Unless --format is");
+  puts("                               given too, the formatted output is disabled");
+  puts("      --flush-size=BYTES       write outputs when BYTES are pending [4096]");
+  puts("      --flush-interval=MS      write outputs at least every MS milliseconds");
+  puts("                               [1000]");
+  puts("      --serve=ADDRESS          publish records (and images) to clients");
+  puts("                               connecting to ADDRESS, which is either");
+  puts("                               'unix:PATH' or 'tcp:PORT' on localhost");
+  puts("      --serve-format=TYPE      encoding of published records, 'csv',");
+  puts("                               'jsonl' or 'bin'. Images are published");
+  puts("                               for 'jsonl' only [jsonl]");
+  puts("      --serve-queue=COUNT      drop clients lagging COUNT messages behind");
+  printf("                               [%i]\n", VC_GDM70X_SERVER_QUEUE);
+  puts("      --trigger=CONDITION      only output records around the records");
+  puts("                               matching CONDITION, see below");
+  puts("      --pre=COUNT              records before the trigger [10]");
+  puts("      --post=COUNT             records after the trigger [10]");
+  puts("      --tap=FILE               write the raw bytes received from the GDM");
+  puts("                               to the capture FILE");
+  puts("      --replay=FILE            decode the capture FILE instead of reading");
+  puts("                               the device, as fast as possible");
+  puts("      --replay-paced           replay with the timing of the capture");
+  puts("      --shm=NAME               publish the latest record and image in the");
+  puts("                               shared memory segment NAME, e.g. /gdm70x");
+  puts("      --dejitter[=COUNT]       replace the arrival time of the records by");
+  puts("                               the time estimated from the last COUNT");
+  printf("                               records [%i]\n", VC_GDM70X_CLOCK_WINDOW);
+  puts("      --spectrum[=COUNT]       print the dominant frequency and amplitude");
+  printf("                               of the last COUNT records [%i]\n",
+	 VC_GDM70X_SPECTRUM_SIZE);
+  puts("      --spectrum-interval=COUNT");
+  puts("                               records between two spectra [spectrum COUNT]");
+  puts("      --derive=NAME=EXPR       derive a value from D1 and D2, e.g. P=D1*D2.");
+  puts("                               It is appended to the csv and jsonl outputs");
+  puts("      --calib=D1=EXPR          replace a channel by EXPR, e.g. D1=D1*1.002-10m");
+  puts("                               Expressions are evaluated in the given order");
   puts("  -v, --verbose                makes output more noisy, repeating the switch");
   puts("                               increases level of noise");
   puts("  -V, --version                prints version info");
@@ -280,6 +785,10 @@ void print_help()
   puts("  %I       Number of Record from GDM");
   puts("  %C       Time the record was transmitted by GDM in seconds since epoch.");
   puts("  %S       Time the record was transmitted by GDM in seconds since program start.");
+  puts("  %R       Time the record was received in seconds since epoch.");
+  puts("  %K       Index of the record as counted by the GDM, with --dejitter.");
+  puts("  %G       Number of records lost before this one, with --dejitter.");
+  puts("  %{NAME}  Value derived by --derive=NAME=EXPR.");
   puts("  %%       character '%'");
   puts("");
   puts("  \\n       newline");
@@ -296,6 +805,19 @@ void print_help()
   puts("  %y  actual date - year as 2 digit integer");
   puts("  %N  an 4 digit integer, which is counted up from zero until");
   puts("      an unused filename is found.");
+  puts("\nIf the device gets lost (e.g. an usb adapter is unplugged), it is");
+  puts("reopened as soon as it reappears. The outage is written to the output");
+  puts("as a line '# outage from START to END (DURATION s)' with the times");
+  puts("in seconds since program start.");
+  puts("\nA trigger CONDITION is D1 or D2 followed by '<' (below), '>' (above),");
+  puts("'/' (rising), '\\' (falling) and the level, or by '=' (inside) or '!'");
+  puts("(outside) and LOW:HIGH. Levels are in V, A, Ohm..., and may end with");
+  puts("n, u, m, k or M, e.g. 'D1<11.5' or 'D2!1m:20m'. When the trigger fires,");
+  puts("a line '# trigger N at TIME' is written to the output. With images");
+  puts("enabled, only the last image before each trigger is saved.");
+  puts("\nAn image delta file starts with the line 'GDM70X-DELTA 1' followed by");
+  puts("a line naming the keyframe xpm file. The rest of the file is the");
+  puts("run length encoded xor of both bitmaps (see vc_gdm70x_image_delta).");
 
 }
 
@@ -306,17 +828,40 @@ int main(int argc, char** argv){
   int retval = 0;
 
   int enable_image = 0;
+  int image_changed = 0;
   const char* p_device = default_device;
   const char* p_print = default_print;
   const char* p_file = default_file;
+  const char* p_archive = 0;
+  int failures = 0, delay;
+  int print_enabled = 1, format_given = 0;
+  const char* p_outputs[MAX_OUTPUTS];
+  int outputs = 0;
+  long flush_size = VC_GDM70X_SINK_BLOCK;
+  int flush_interval = 1000;
+  int wait_ms;
+  struct vc_gdm70x_sink* sink_p;
+  const char* p_serve = 0;
+  int serve_type = VC_GDM70X_SINK_JSONL;
+  int serve_queue = VC_GDM70X_SERVER_QUEUE;
+  const char* p_trigger = 0;
+  int trigger_pre = 10, trigger_post = 10;
+  const char* p_tap = 0;
+  const char* p_replay = 0;
+  int replay_mode = VC_GDM70X_REPLAY_FAST;
+  const char* p_shm = 0;
+  int clock_window = 0;
+  int spectrum_size = 0, spectrum_interval = 0;
+  struct sigaction sa;
 
   int record_max = 0;
   
-  while( (c=getopt_long(argc,argv,":f:d:c:vihV",longopts,NULL)) != -1 )
+  while( (c=getopt_long(argc,argv,":f:d:c:k:a:o:viuhV",longopts,NULL)) != -1 )
     {
       switch(c) {
       case 'f':
 	p_print = optarg;
+	format_given = 1;
 	break;
       case 'd':
 	p_device = optarg;
@@ -330,6 +875,128 @@ int main(int argc, char** argv){
       case 'i':
 	enable_image = 1;
 	break;
+      case 'u':
+	image_changed = 1;
+	break;
+      case 'k':
+	image_delta_interval = atoi(optarg);
+	if(image_delta_interval < 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: image delta count musst be greater or equal than 0.\n");
+	}
+	break;
+      case 'K':
+	p_delta = optarg;
+	break;
+      case 'a':
+	p_archive = optarg;
+	break;
+      case 'o':
+	if(outputs < MAX_OUTPUTS)
+	  p_outputs[outputs++] = optarg;
+	else {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: too many outputs.\n");
+	}
+	break;
+      case 'S':
+	flush_size = atol(optarg);
+	if(flush_size <= 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: flush size musst be greater than 0.\n");
+	}
+	break;
+      case 'I':
+	flush_interval = atoi(optarg);
+	if(flush_interval < 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: flush interval musst be greater or equal than 0.\n");
+	}
+	break;
+      case 'L':
+	p_serve = optarg;
+	break;
+      case 'R':
+	serve_type = sink_type(optarg,strlen(optarg));
+	if(serve_type < 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: invalid serve format '%s'.\n",optarg);
+	}
+	break;
+      case 'Q':
+	serve_queue = atoi(optarg);
+	if(serve_queue < 1 || serve_queue > VC_GDM70X_SERVER_QUEUE) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: serve queue musst be between 1 and %i.\n",
+		  VC_GDM70X_SERVER_QUEUE);
+	}
+	break;
+      case 'B':
+	max_backoff = atoi(optarg) * 1000;
+	if(max_backoff <= 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: maximum backoff musst be greater than 0.\n");
+	}
+	break;
+      case 'T':
+	p_trigger = optarg;
+	break;
+      case 'P':
+	trigger_pre = atoi(optarg);
+	if(trigger_pre < 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: pre count musst be greater or equal than 0.\n");
+	}
+	break;
+      case 'O':
+	trigger_post = atoi(optarg);
+	if(trigger_post < 0) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: post count musst be greater or equal than 0.\n");
+	}
+	break;
+      case 'W':
+	p_tap = optarg;
+	break;
+      case 'Y':
+	p_replay = optarg;
+	break;
+      case 'y':
+	replay_mode = VC_GDM70X_REPLAY_PACED;
+	break;
+      case 'M':
+	p_shm = optarg;
+	break;
+      case 'J':
+	clock_window = optarg ? atoi(optarg) : VC_GDM70X_CLOCK_WINDOW;
+	if(clock_window < 2) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: dejitter count musst be at least 2.\n");
+	}
+	break;
+      case 'N':
+	spectrum_size = optarg ? atoi(optarg) : VC_GDM70X_SPECTRUM_SIZE;
+	if(spectrum_size < 8) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: spectrum size musst be at least 8.\n");
+	}
+	break;
+      case 'Z':
+	spectrum_interval = atoi(optarg);
+	if(spectrum_interval < 1) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: spectrum interval musst be at least 1.\n");
+	}
+	break;
+      case 'E':
+      case 'C':
+	if(!expr_p && !(expr_p = vc_gdm70x_expr_create()))
+	  exit(-1);
+	if(vc_gdm70x_expr_parse(expr_p,optarg,c == 'C')) {
+	  retval = -1;
+	  fprintf(stderr,"vc-gdm70x: invalid expression '%s'.\n",optarg);
+	}
+	break;
       case 'c':
 	record_max = atoi(optarg);
 	if(record_max < 0) {
@@ -370,20 +1037,137 @@ int main(int argc, char** argv){
     exit(-1);
   }
 
-  vc_gdm70x_setfunc_data(gdm_p,print_values, (void*)p_print);
+  /* outputs are chained in the order given */
+  for(c = outputs - 1; c >= 0; c--) {
+    /* the tslog is no sink, it compresses whole blocks */
+    if(strncmp(p_outputs[c],"tslog:",6) == 0) {
+      if(tslog_p)
+        fprintf(stderr,"vc-gdm70x: only one tslog output is supported.\n");
+      else if(!(tslog_p = vc_gdm70x_tslog_open(p_outputs[c] + 6,VC_GDM70X_TSLOG_APPEND)))
+        fprintf(stderr,"vc-gdm70x: vc_gdm70x_tslog_open failed.\n");
+      else {
+        vc_gdm70x_tslog_setflush(tslog_p,flush_interval);
+        continue;
+      }
+      retval = -1;
+      goto cleanup;
+    }
+
+    sink_p = open_sink(p_outputs[c]);
+    if(!sink_p) {
+      retval = -1;
+      goto cleanup;
+    }
+    vc_gdm70x_sink_setflush(sink_p,flush_size,flush_interval);
+    if(expr_p && sink_p->type != VC_GDM70X_SINK_BINARY)
+      vc_gdm70x_sink_setexpr(sink_p,expr_p);
+    sink_p->next = sinks;
+    sinks = sink_p;
+  }
+
+  if(outputs && !format_given)
+    print_enabled = 0;
+
+  if(p_serve) {
+    server_p = vc_gdm70x_server_open(p_serve,serve_type);
+    if(!server_p) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_server_open failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+    vc_gdm70x_server_setqueue(server_p,serve_queue);
+  }
+
+  if(clock_window) {
+    clock_p = vc_gdm70x_clock_create(clock_window);
+    if(!clock_p) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_clock_create failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+  }
+
+  if(spectrum_size) {
+    spectrum_p = vc_gdm70x_spectrum_create(spectrum_size,0);
+    if(!spectrum_p) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_spectrum_create failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+    if(spectrum_interval)
+      vc_gdm70x_spectrum_setinterval(spectrum_p,spectrum_interval);
+    vc_gdm70x_spectrum_setfunc_report(spectrum_p,on_spectrum,
+				      print_enabled ? (void*)p_print : 0);
+  }
+
+  if(p_shm) {
+    shm_p = vc_gdm70x_shm_create(p_shm);
+    if(!shm_p) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_shm_create failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+  }
+
+  if(p_trigger) {
+    trigger_p = vc_gdm70x_trigger_create(trigger_pre,trigger_post);
+    if(!trigger_p || vc_gdm70x_trigger_parse(trigger_p,p_trigger)) {
+      fprintf(stderr,"vc-gdm70x: invalid trigger '%s'.\n",p_trigger);
+      retval = -1;
+      goto cleanup;
+    }
+    vc_gdm70x_trigger_setfunc_record(trigger_p,on_trigger_record,
+				     print_enabled ? (void*)p_print : 0);
+    vc_gdm70x_trigger_setfunc_fire(trigger_p,on_trigger_fire,
+				   print_enabled ? (void*)p_print : 0);
+  }
+
+  vc_gdm70x_setfunc_data(gdm_p,on_data, print_enabled ? (void*)p_print : 0);
+
+  if(enable_image && p_archive) {
+    archive_p = vc_gdm70x_archive_open(p_archive,VC_GDM70X_ARCHIVE_APPEND);
+    if(!archive_p) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_archive_open failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+    vc_gdm70x_archive_setkeyframe(archive_p,image_delta_interval);
+    store_image = write_archive;
+    image_ptr = archive_p;
+  } else if(enable_image) {
+    store_image = write_delta;
+    image_ptr = (void*)p_file;
+  }
 
-  if(enable_image)
-    vc_gdm70x_setfunc_image(gdm_p,write_xpm,(void*)p_file);
+  /* the shared memory and the server get the images even if they are
+     not saved */
+  if(enable_image || shm_p || server_p)
+    vc_gdm70x_setfunc_image(gdm_p,on_image,image_ptr);
   else
     vc_gdm70x_setfunc_image(gdm_p,0,0);
 
+  if(image_changed)
+    vc_gdm70x_setimagemode(gdm_p,VC_GDM70X_IMAGE_CHANGED);
+
   if(verbose)
     fprintf(stderr,"vc-gdm70x: trying to open serial port.\n");
 
-  if(vc_gdm70x_open(gdm_p, p_device)) {
+  if(p_replay) {
+    if(vc_gdm70x_open_replay(gdm_p, p_replay, replay_mode)) {
+      fprintf(stderr,"vc-gdm70x: vc_gdm70x_open_replay failed.\n");
+      retval = -1;
+      goto cleanup;
+    }
+  } else if(vc_gdm70x_open(gdm_p, p_device)) {
     fprintf(stderr,"vc-gdm70x: vc_gdm70x_open failed.\n");
-    vc_gdm70x_destroy(gdm_p);
-    exit(-1);
+    retval = -1;
+    goto cleanup;
+  }
+
+  if(p_tap && vc_gdm70x_tap(gdm_p, p_tap)) {
+    fprintf(stderr,"vc-gdm70x: vc_gdm70x_tap failed.\n");
+    retval = -1;
+    goto cleanup;
   }
 
   if(verbose)
@@ -391,29 +1175,91 @@ int main(int argc, char** argv){
 
   if(vc_gdm70x_sync(gdm_p)) {
     fprintf(stderr,"vc_gdm70x: vc_gdm70x_sync failed.\n");
-    vc_gdm70x_destroy(gdm_p);
-    exit(-1);
+    retval = -1;
+    goto cleanup;
   }
 
   if(verbose)
     fprintf(stderr,"vc-gdm70x: measuring.\n");
 
   clock_gettime(CLOCK_REALTIME,&ts_start);
+
+  /* replayed records are timed relative to the start of the capture */
+  if(p_replay)
+    vc_gdm70x_capture_start(gdm_p,&ts_start);
+
+  /* wake up in time for flushing the outputs */
+  wait_ms = (flush_interval < 1000) ? flush_interval : 1000;
+  if(wait_ms < 10)
+    wait_ms = 10;
+
+  if(!p_replay)
+    vc_gdm70x_setfunc_idle(gdm_p,on_idle,0,wait_ms);
+
+  /* terminate the loop on signals, so the archive index gets written */
+  memset(&sa,0,sizeof(sa));
+  sa.sa_handler = stop_handler;
+  sigaction(SIGINT,&sa,NULL);
+  sigaction(SIGTERM,&sa,NULL);
   
-  if(record_max == 0) {
-    while(1)
-      vc_gdm70x_do(gdm_p,0);
-  } else {
-    while(record_count++ < record_max) {
-      vc_gdm70x_do(gdm_p,1);
+  while(running && (record_max == 0 || record_count++ < record_max)) {
+    /* serve the clients while waiting for the meter, the outputs are
+       flushed in time even if the meter stalls */
+    if(server_p)
+      while(running && vc_gdm70x_server_wait(server_p,gdm_p->fd,wait_ms) == 0)
+	flush_outputs(0);
+    else if(!p_replay)
+      while(running && wait_meter(gdm_p->fd,wait_ms) == 0)
+	flush_outputs(0);
+
+    if(!running)
+      break;
+
+    if(vc_gdm70x_do(gdm_p,record_max != 0) == 0) {
+      failures = 0;
+      continue;
+    }
+
+    if(!running)
+      break;
+
+    /* nothing gets written while waiting for the meter, a single bad
+       frame leaves the outputs alone */
+    if(vc_gdm70x_check(gdm_p)) {
+      flush_outputs(1);
+      if(p_replay || reconnect(gdm_p,p_device))
+	break;
+      failures = 0;
+    } else if(!p_replay && ++failures >= 3) {
+      flush_outputs(1);
+      /* device is there but does not talk to us, don't spin */
+      for(delay = 100, c = 3; (c < failures) && (delay < max_backoff); c++)
+	delay *= 2;
+      backoff_sleep( (delay < max_backoff) ? delay : max_backoff);
     }
   }
-  
+
+cleanup:
   vc_gdm70x_destroy(gdm_p);
 
-  if(verbose)
+  if(archive_p)
+    vc_gdm70x_archive_close(archive_p);
+
+  vc_gdm70x_sink_close(sinks);
+  vc_gdm70x_tslog_close(tslog_p);
+
+  if(server_p)
+    vc_gdm70x_server_close(server_p);
+
+  vc_gdm70x_trigger_destroy(trigger_p);
+  vc_gdm70x_shm_close(shm_p);
+  vc_gdm70x_clock_destroy(clock_p);
+  vc_gdm70x_expr_destroy(expr_p);
+  vc_gdm70x_spectrum_destroy(spectrum_p);
+
+  if(verbose && !retval)
     fprintf(stderr,"vc-gdm70x: exiting successfully.\n");
 
-  return 0;
+  return retval;
 }
 
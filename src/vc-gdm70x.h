@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef __VC_GDM70X__
 #define __VC_GDM70X__
 
+#include <stdio.h>
 #include <termios.h>
 #include <time.h>
 
@@ -53,6 +54,23 @@ enum vc_mult {
          OVER='#',
 };
 
+/* size of the bitmap of a received image (128x64 pixel, 1 bit per pixel) */
+#define VC_GDM70X_IMAGE_SIZE 1024
+
+/* size of a data frame and of an image frame sent by the GDM */
+#define VC_GDM70X_FRAME_DATA  26
+#define VC_GDM70X_FRAME_IMAGE 1040
+
+/* maximum size of a delta created by vc_gdm70x_image_delta */
+#define VC_GDM70X_DELTA_MAX (VC_GDM70X_IMAGE_SIZE + VC_GDM70X_IMAGE_SIZE / 128)
+
+/* selects which images are passed to the image callback */
+
+enum vc_gdm70x_image_mode {
+  VC_GDM70X_IMAGE_ALL     = 0, /* every received image */
+  VC_GDM70X_IMAGE_CHANGED = 1, /* only images differing from the last one */
+};
+
 /* struct containing the received data from one channel */
 
 struct vc_gdm70x_data {
@@ -61,6 +79,24 @@ struct vc_gdm70x_data {
   enum vc_mult mult;
 };
 
+/* struct containing a complete record of both channels */
+
+struct vc_gdm70x_record {
+  struct timespec ts;
+  struct vc_gdm70x_data data1;
+  struct vc_gdm70x_data data2;
+};
+
+/* return values of vc_gdm70x_next */
+
+enum vc_gdm70x_event {
+  VC_GDM70X_NONE  = 0, /* nothing new, e.g. an unchanged image */
+  VC_GDM70X_DATA  = 1, /* data1, data2 and ts got updated */
+  VC_GDM70X_IMAGE = 2, /* image and ts got updated */
+};
+
+struct vc_gdm70x_capture;
+
 /* struct containing all import information of a GDM meter */
 
 struct vc_gdm70x {
@@ -85,6 +121,19 @@ struct vc_gdm70x {
   void* func_data_ext;
   void* func_image_ext;
 
+  int image_mode;
+  int image_fp_valid;
+  unsigned long long image_fp; /* fingerprint of the last image */
+
+  int error; /* errno of the last failed read */
+  int image_owned; /* image was allocated by the library */
+
+  struct vc_gdm70x_capture* tap;    /* copy of the received bytes */
+  struct vc_gdm70x_capture* replay; /* capture read instead of fd */
+
+  int (* func_idle) (struct vc_gdm70x* gdm_p, void* ptr);
+  void* func_idle_ext;
+  int idle_ms; /* interval func_idle is called at */
 };
 
 
@@ -96,6 +145,17 @@ extern struct vc_gdm70x* vc_gdm70x_create();
 /* vc_gdm70x_destroy: destroy a vc_gdm70x struct */
 extern void vc_gdm70x_destroy(struct vc_gdm70x* gdm_p);
 
+/* vc_gdm70x_init: initialize a vc_gdm70x struct allocated by the caller */
+extern void vc_gdm70x_init(struct vc_gdm70x* gdm_p);
+
+/* vc_gdm70x_fini: close and release a struct set up by vc_gdm70x_init */
+extern void vc_gdm70x_fini(struct vc_gdm70x* gdm_p);
+
+/* vc_gdm70x_setimagebuffer: receive images into a buffer of the caller
+   holding VC_GDM70X_IMAGE_SIZE bytes, 0 to stop receiving images, which
+   also removes the image callback */
+extern void vc_gdm70x_setimagebuffer(struct vc_gdm70x* gdm_p, unsigned char* image);
+
 /* vc_gdm70x_setfunc_data: set the callback func for a record */
 extern int vc_gdm70x_setfunc_data( struct vc_gdm70x* gdm_p, 
 				   int (* func_data)(struct vc_gdm70x* gdm_p, void* ptr),
@@ -106,9 +166,46 @@ extern int vc_gdm70x_setfunc_image( struct vc_gdm70x* gdm_p,
 				    int (* func_image) (struct vc_gdm70x* gdm_p, void* ptr),
 				    void* image_ptr);
 
+/* vc_gdm70x_setfunc_idle: set a callback func called every ms milliseconds
+   while waiting for bytes of the meter, e.g. to flush outputs while it
+   stalls within a frame. If it returns != 0 the read times out at once */
+extern int vc_gdm70x_setfunc_idle( struct vc_gdm70x* gdm_p,
+				   int (* func_idle) (struct vc_gdm70x* gdm_p, void* ptr),
+				   void* idle_ptr, int ms);
+
+/* vc_gdm70x_setimagemode: select which images are passed to func_image */
+extern int vc_gdm70x_setimagemode(struct vc_gdm70x* gdm_p, int mode);
+
+/* vc_gdm70x_image_fingerprint: 64 bit fingerprint of an image bitmap */
+extern unsigned long long vc_gdm70x_image_fingerprint(const unsigned char* image);
+
+/* vc_gdm70x_image_delta: xor image against key and run length encode the
+   result into buf, which must hold VC_GDM70X_DELTA_MAX bytes. returns the
+   number of bytes written */
+extern int vc_gdm70x_image_delta(const unsigned char* key, 
+				 const unsigned char* image,
+				 unsigned char* buf);
+
+/* vc_gdm70x_image_undelta: restore an image from key and a delta created by
+   vc_gdm70x_image_delta */
+extern int vc_gdm70x_image_undelta(const unsigned char* key,
+				   const unsigned char* delta, int size,
+				   unsigned char* image);
+
+/* vc_gdm70x_image_write_xpm: write an image as xpm file */
+extern int vc_gdm70x_image_write_xpm(FILE* fp, const unsigned char* image);
+
+/* vc_gdm70x_image_write_pbm: write an image as binary pbm, several
+   images written to the same file form an image sequence */
+extern int vc_gdm70x_image_write_pbm(FILE* fp, const unsigned char* image);
+
 /* vc_gdm70x_open: open a tty for communication */
 extern int  vc_gdm70x_open( struct vc_gdm70x* gdm_p, const char* device);
 
+/* vc_gdm70x_check: check if the tty is still usable, returns -1 if the
+   device is gone (e.g. usb adapter unplugged) and must be reopened */
+extern int vc_gdm70x_check(struct vc_gdm70x* gdm_p);
+
 /* vc_gdm70x_close: close the tty */
 extern void vc_gdm70x_close(struct vc_gdm70x* gdm_p);
 
@@ -118,6 +215,28 @@ extern int vc_gdm70x_sync(struct vc_gdm70x* gdm_p);
 /* vc_gdm70x_do: receive and evaluate data from the GDM */
 extern int vc_gdm70x_do(struct vc_gdm70x* gdm_p, int skip);
 
+/* vc_gdm70x_next: receive the next record or image without calling the
+   callback functions, returns one of enum vc_gdm70x_event or -1. Images
+   are only reported while there is an image buffer */
+extern int vc_gdm70x_next(struct vc_gdm70x* gdm_p);
+
+/* vc_gdm70x_getrecord: copy the last received record */
+extern void vc_gdm70x_getrecord(const struct vc_gdm70x* gdm_p,
+				struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_framesize: size of the frame at buf, 0 if buf does not start
+   with a complete frame */
+extern size_t vc_gdm70x_framesize(const unsigned char* buf, size_t len);
+
+/* vc_gdm70x_parseframe: decode the values of a data frame, ts of rec_p is
+   left untouched */
+extern int vc_gdm70x_parseframe(const unsigned char* frame,
+				struct vc_gdm70x_record* rec_p);
+
+/* vc_gdm70x_data_si: value of a channel with the multiplier applied,
+   NAN on overflow */
+extern double vc_gdm70x_data_si(const struct vc_gdm70x_data* data_p);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,210 @@
+/*
+This file is part of libvc-gdm70x, a library to connect to Voltcraft GDM 70x
+Multimeters via RS232.
+
+Copyright (C) 2005-2013  Andreas Messer <andi@bastelmap.de>
+
+libvc-gdm70x is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __VC_GDM70X_HPP__
+#define __VC_GDM70X_HPP__
+
+/* C++20 interface to libvc-gdm70x. The meter struct and the image buffer
+   are members of gdm70x::Meter, so a Meter on the stack needs no heap
+   memory at all. Records are fetched with vc_gdm70x_next instead of
+   callbacks, the handlers passed to poll() are called directly and can
+   be inlined. */
+
+#include "vc-gdm70x.h"
+
+#include <cerrno>
+#include <cstring>
+#include <span>
+#include <system_error>
+#include <utility>
+
+namespace gdm70x {
+
+using Record = vc_gdm70x_record;
+using Data   = vc_gdm70x_data;
+using Image  = std::span<const unsigned char, VC_GDM70X_IMAGE_SIZE>;
+
+enum class Event : int {
+  error = -1,
+  none  = VC_GDM70X_NONE,
+  data  = VC_GDM70X_DATA,
+  image = VC_GDM70X_IMAGE,
+};
+
+class Meter {
+public:
+  Meter() noexcept
+  {
+    vc_gdm70x_init(&gdm_);
+  }
+
+  /* open device, throws std::system_error on failure */
+  explicit Meter(const char* device, bool images = false) : Meter()
+  {
+    enable_images(images);
+    if(!open(device))
+      throw std::system_error(errno ? errno : EIO, std::generic_category(),
+                              "vc_gdm70x_open");
+  }
+
+  Meter(const Meter&) = delete;
+  Meter& operator=(const Meter&) = delete;
+
+  Meter(Meter&& other) noexcept
+  {
+    take(other);
+  }
+
+  Meter& operator=(Meter&& other) noexcept
+  {
+    if(this != &other) {
+      vc_gdm70x_fini(&gdm_);
+      take(other);
+    }
+    return *this;
+  }
+
+  /* closes the tty, which restores its termios settings */
+  ~Meter()
+  {
+    vc_gdm70x_fini(&gdm_);
+  }
+
+  bool open(const char* device) noexcept
+  {
+    if(is_open())
+      close();
+    return vc_gdm70x_open(&gdm_, device) == 0;
+  }
+
+  void close() noexcept
+  {
+    if(is_open())
+      vc_gdm70x_close(&gdm_);
+  }
+
+  bool is_open() const noexcept
+  {
+    return gdm_.fd >= 0;
+  }
+
+  bool sync() noexcept
+  {
+    return vc_gdm70x_sync(&gdm_) == 0;
+  }
+
+  /* receive images into the internal buffer */
+  void enable_images(bool enable) noexcept
+  {
+    vc_gdm70x_setimagebuffer(&gdm_, enable ? image_ : nullptr);
+  }
+
+  /* only report images differing from the last one */
+  void only_changed_images(bool enable) noexcept
+  {
+    vc_gdm70x_setimagemode(&gdm_, enable ? VC_GDM70X_IMAGE_CHANGED
+                                         : VC_GDM70X_IMAGE_ALL);
+  }
+
+  /* receive the next record or image and pass it to the matching handler */
+  template<class F, class G>
+  Event poll(F&& on_data, G&& on_image)
+  {
+    Event event = next();
+
+    if(event == Event::data)
+      std::forward<F>(on_data)(record());
+    else if(event == Event::image)
+      std::forward<G>(on_image)(image(), gdm_.ts);
+
+    return event;
+  }
+
+  template<class F>
+  Event poll(F&& on_data)
+  {
+    return poll(std::forward<F>(on_data), [](Image, const timespec&) {});
+  }
+
+  Event next() noexcept
+  {
+    return static_cast<Event>(vc_gdm70x_next(&gdm_));
+  }
+
+  /* fill out with consecutive records, images in between are skipped.
+     returns the number of records read, which is less than out.size()
+     if an error occured */
+  std::size_t read(std::span<Record> out) noexcept
+  {
+    std::size_t n = 0;
+
+    while(n < out.size()) {
+      Event event = next();
+
+      if(event == Event::error)
+        break;
+      if(event == Event::data)
+        vc_gdm70x_getrecord(&gdm_, &out[n++]);
+    }
+
+    return n;
+  }
+
+  Record record() const noexcept
+  {
+    return Record{gdm_.ts, gdm_.data1, gdm_.data2};
+  }
+
+  /* the last received image, valid if images are enabled */
+  Image image() const noexcept
+  {
+    return Image(image_, VC_GDM70X_IMAGE_SIZE);
+  }
+
+  vc_gdm70x* native() noexcept
+  {
+    return &gdm_;
+  }
+
+  const vc_gdm70x* native() const noexcept
+  {
+    return &gdm_;
+  }
+
+private:
+  void take(Meter& other) noexcept
+  {
+    gdm_ = other.gdm_;
+
+    if(other.gdm_.image == other.image_) {
+      std::memcpy(image_, other.image_, sizeof(image_));
+      gdm_.image = image_;
+    }
+
+    /* the source must neither close the tty nor free the image */
+    vc_gdm70x_init(&other.gdm_);
+  }
+
+  vc_gdm70x gdm_;
+  unsigned char image_[VC_GDM70X_IMAGE_SIZE]{};
+};
+
+}
+
+#endif